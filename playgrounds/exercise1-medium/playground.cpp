@@ -5,6 +5,11 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -41,6 +46,137 @@ static const GLubyte cube_indices[] = {
 	0,3,1,2,6,3,7,0,4,1,5,6,4,7, // facing outside
 };
 
+typedef std::chrono::steady_clock Clock;
+
+static double msBetween(Clock::time_point a, Clock::time_point b) {
+	return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+// Mean, deviation and worst case of a series of intervals in milliseconds.
+struct Jitter {
+	int count;
+	double sum, sumSq, worst;
+	Jitter() { reset(); }
+	void reset() {
+		count = 0;
+		sum = sumSq = worst = 0.0;
+	}
+	void add(double ms) {
+		count++;
+		sum += ms;
+		sumSq += ms*ms;
+		worst = std::max(worst, ms);
+	}
+	double mean() const {
+		return count ? sum/count : 0.0;
+	}
+	double deviation() const {
+		return count ? std::sqrt(std::max(0.0, sumSq/count - mean()*mean())) : 0.0;
+	}
+};
+
+// Hands snapshots from one writer thread to one reader thread without locking.
+// The writer never waits, and the reader always gets the newest complete snapshot.
+template<class T>
+class TripleBuffer {
+private:
+	static const unsigned FRESH = 4; // set while the middle slot holds an unread snapshot
+	T slots[3];
+	std::atomic<unsigned> middle;
+	unsigned back;  // only touched by the writer
+	unsigned front; // only touched by the reader
+public:
+	TripleBuffer() : middle(1), back(0), front(2) {}
+	T& writeSlot() {
+		return slots[back];
+	}
+	void publish() {
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+	}
+	// true if a newer snapshot was published since the last call
+	bool update() {
+		if (!(middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+		return true;
+	}
+	const T& read() const {
+		return slots[front];
+	}
+};
+
+// How often the simulation steps; the cube turns by the old per-frame degree each tick.
+static const double TICK = 1.0/60.0;
+
+// What the simulation thread publishes every tick. Never changed once published.
+struct Snapshot {
+	double time;    // simulated seconds since the start
+	Clock::time_point published;
+	float angle;    // rotation of the cube in degrees, in [0,360)
+	int triangles;  // number of strip indices to draw
+	Jitter tick;    // intervals between the ticks of the last second
+};
+
+// The simulation thread: steps at a fixed rate, independent of how fast frames are drawn.
+// Space bar presses are counted by the render thread, which owns the window.
+static void simulate(TripleBuffer<Snapshot>* out, const std::atomic<bool>* running,
+		std::atomic<int>* presses, Clock::time_point start) {
+	Snapshot state;
+	state.time = 0.0;
+	state.angle = 45.0f;
+	state.triangles = 3;
+	Jitter ticks;
+	Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(TICK));
+	Clock::time_point next = start, last = start;
+	for (long tick=0; running->load(std::memory_order_relaxed); tick++) {
+		for (int n = presses->exchange(0); n > 0; n--) {
+			state.triangles++;
+			if (state.triangles>14)
+				state.triangles=3;
+			printf("%d\n",state.triangles);
+		}
+		// rotate the cube by one degree per tick
+		state.angle += 1.0f;
+		if (state.angle>=360.0f)
+			state.angle -= 360.0f;
+		state.time = tick*TICK;
+		Clock::time_point now = Clock::now();
+		ticks.add(msBetween(last, now));
+		last = now;
+		if (ticks.count == 60) {
+			state.tick = ticks;
+			ticks.reset();
+		}
+		state.published = now;
+		out->writeSlot() = state;
+		out->publish();
+		next += step;
+		// after a long stall (e.g. a debugger) don't try to catch up tick by tick
+		if (Clock::now() - next > 15*step)
+			next = Clock::now();
+		std::this_thread::sleep_until(next);
+	}
+}
+
+// blends two angles in degrees the short way around
+static float lerpAngle(float a, float b, float t) {
+	float d = b - a;
+	if (d > 180.0f)
+		d -= 360.0f;
+	if (d < -180.0f)
+		d += 360.0f;
+	return a + d*t;
+}
+
+// Reports GL errors as the driver notices them, instead of polling glGetError() every frame.
+static void APIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity,
+		GLsizei length, const GLchar* message, const void* userParam) {
+	if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+		return;
+	fprintf(stderr, "OpenGL %s (source 0x%x, type 0x%x, id %u): %s\n",
+		type == GL_DEBUG_TYPE_ERROR ? "Error" : "message", source, type, id, message);
+}
+
 GLuint MyLoadShaders(const char * vertex_file_path,const char * fragment_file_path) { 
     // Create the shaders
     GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -129,6 +265,7 @@ int main( void )
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 
 	// Open a window and create its OpenGL context
 	window = glfwCreateWindow( 1024, 768, "Tutorial 01", NULL, NULL);
@@ -164,6 +301,13 @@ int main( void )
 	    fprintf(stderr, "0 OpenGL Error: %d\n", error);
 	}
 
+	// with KHR_debug errors are reported as they happen; otherwise poll once a frame
+	bool debugOutput = GLEW_KHR_debug != 0;
+	if (debugOutput) {
+		glEnable(GL_DEBUG_OUTPUT);
+		glDebugMessageCallback(debugMessage, NULL);
+	}
+
 	GLuint VertexArrayID;
 	glGenVertexArrays(1, &VertexArrayID);
 	glBindVertexArray(VertexArrayID);
@@ -201,14 +345,49 @@ int main( void )
 	);
 	glm::mat4 MVP0 = projection * view;
 
-	int i=3;
-	float j=45.0f;
 	bool canInc = true;
 	
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 
+	// the simulation runs on its own thread; frames blend the two newest snapshots
+	TripleBuffer<Snapshot> snapshots;
+	std::atomic<bool> simulating(true);
+	std::atomic<int> presses(0);
+	Clock::time_point start = Clock::now();
+	std::thread simulation(simulate, &snapshots, &simulating, &presses, start);
+	while (!snapshots.update())
+		std::this_thread::yield();
+	Snapshot prev = snapshots.read(), curr = prev;
+	Jitter frames, ages;
+	Clock::time_point lastFrame = Clock::now(), lastReport = lastFrame;
+
 	do{
+		if (snapshots.update()) {
+			prev = curr;
+			curr = snapshots.read();
+		}
+		// draw one tick in the past, so there is always a newer snapshot to blend towards
+		Clock::time_point now = Clock::now();
+		// measured from the newest snapshot, not from start: after a long stall the
+		// simulation skips ahead and its time no longer matches the wall clock
+		double simNow = curr.time + msBetween(curr.published, now)/1000.0 - TICK;
+		float alpha = 1.0f;
+		if (curr.time > prev.time)
+			alpha = std::min(1.0, std::max(0.0, (simNow - prev.time) / (curr.time - prev.time)));
+		ages.add(msBetween(curr.published, now));
+		frames.add(msBetween(lastFrame, now));
+		lastFrame = now;
+		if (msBetween(lastReport, now) >= 1000.0) {
+			printf("frame %.2f ms +-%.2f (worst %.2f) | tick %.2f ms +-%.3f (worst %.2f) | snapshot age %.2f ms (worst %.2f)\n",
+				frames.mean(), frames.deviation(), frames.worst,
+				curr.tick.mean(), curr.tick.deviation(), curr.tick.worst,
+				ages.mean(), ages.worst);
+			frames.reset();
+			ages.reset();
+			lastReport = now;
+		}
+
 		// clear screen
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		// some gl magic; look it up.
@@ -224,10 +403,8 @@ int main( void )
         );
         // actually use our shaders
         glUseProgram(shader);
-        // rotate the cube by angle j
-		j = j+1.0f;
-		if (j>360.0f)
-			j -= 360.0f;
+        // rotate the cube by the blended angle
+		float j = lerpAngle(prev.angle, curr.angle, alpha);
         glm::mat4 rotation = glm::rotate(glm::mat4(1.0f),j,glm::vec3(0,1,0));
         glm::mat4 MVP = MVP0 * rotation;
        	GLuint MVP_handle = glGetUniformLocation(shader,"MVP");
@@ -235,13 +412,15 @@ int main( void )
        	glUniformMatrix4fv(MVP_handle, 1, GL_FALSE, &MVP[0][0]);
 		// Draw the triangle !
 //		glDrawArrays(GL_TRIANGLES, 0, 3);
-		glDrawElements(GL_TRIANGLE_STRIP, i, GL_UNSIGNED_BYTE, cube_indices);
+		glDrawElements(GL_TRIANGLE_STRIP, curr.triangles, GL_UNSIGNED_BYTE, cube_indices);
 		glDisableVertexAttribArray(0);
 
-		error = glGetError();
-		if (error != GL_NO_ERROR)
-		{
-			fprintf(stderr, "0 OpenGL Error: %d\n", error);
+		if (!debugOutput) {
+			error = glGetError();
+			if (error != GL_NO_ERROR)
+			{
+				fprintf(stderr, "0 OpenGL Error: %d\n", error);
+			}
 		}
 
 		// Swap buffers
@@ -250,10 +429,7 @@ int main( void )
 		if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
 			if (canInc) {
 				canInc = false;
-				i++;
-				if (i>14)
-					i=3;
-				printf("%d\n",i);
+				presses++;
 			}
 		} else {
 			canInc = true;
@@ -262,6 +438,9 @@ int main( void )
 	while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
 		   glfwWindowShouldClose(window) == 0 );
 
+	simulating = false;
+	simulation.join();
+
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
 
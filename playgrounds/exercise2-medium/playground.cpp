@@ -1,11 +1,26 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <map>
 #include <math.h>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
 
 // Include GLEW
 #include <GL/glew.h>
@@ -20,15 +35,20 @@ GLFWwindow* window;
 
 using namespace glm;
 
+// reads the whole file in one go; false if it can't be opened
+bool readFile(const char * fname, std::string& out) {
+	std::ifstream stream(fname, std::ios::in | std::ios::binary);
+	if (!stream.is_open())
+		return false;
+	std::ostringstream contents;
+	contents << stream.rdbuf();
+	out = contents.str();
+	return true;
+}
+
 std::string getFileContents(const char * fname) {
 	std::string ret;
-	std::ifstream stream(fname, std::ios::in);
-	if(stream.is_open()){
-		std::string Line = "";
-		while(getline(stream, Line))
-			ret += "\n" + Line;
-		stream.close();
-	} else {
+	if (!readFile(fname, ret)) {
 		fprintf(stderr, "Impossible to open %s. Are you in the right directory ?\n", fname);
 		getchar();
 		ret = "ERROR READING FILE";
@@ -36,10 +56,249 @@ std::string getFileContents(const char * fname) {
 	return ret;
 }
 
+typedef std::chrono::steady_clock Clock;
+
+static double msBetween(Clock::time_point a, Clock::time_point b) {
+	return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+// Collects CPU and GPU timings and writes them as Chrome trace events (chrome://tracing).
+// CPU events may come from any thread. GPU timings are GL_TIMESTAMP queries issued on the
+// render thread and read back FRAMES_IN_FLIGHT frames later, so the CPU never waits for them.
+class Profiler {
+private:
+	static const int FRAMES_IN_FLIGHT = 3;
+	static const int MAX_GPU_SCOPES = 8;
+	static const size_t MAX_EVENTS = 1000000;
+	static const int GPU_TID = 0;
+	struct Event {
+		std::string name;
+		const char* cat;
+		char ph;      // 'X' complete, 'i' instant
+		double ts;    // microseconds since start
+		double dur;
+		int tid;
+	};
+	struct GpuFrame {
+		GLuint queries[2*MAX_GPU_SCOPES]; // begin and end timestamp per scope
+		const char* names[MAX_GPU_SCOPES];
+		int used;
+	};
+	Clock::time_point start;
+	// No GL call may be made while holding this: the driver may report a debug message
+	// from inside the call, on this thread, and debugMessage() records it through instant().
+	std::mutex mutex;
+	// guarded by mutex
+	std::vector<Event> events;
+	std::map<std::thread::id, int> tids;
+	std::vector<std::string> threadNames;
+	// render thread only
+	GpuFrame gpuFrames[FRAMES_IN_FLIGHT];
+	int gpuFrame;
+	bool gpuTiming;
+	double gpuOffset; // CPU minus GPU clock, in microseconds
+	unsigned droppedGpuFrames;
+
+	int tid() {
+		auto it = tids.find(std::this_thread::get_id());
+		if (it != tids.end())
+			return it->second;
+		int id = tids.size()+1;
+		tids[std::this_thread::get_id()] = id;
+		threadNames.push_back("thread " + std::to_string(id));
+		return id;
+	}
+	void record(const std::string& name, const char* cat, char ph, double ts, double dur, int threadId) {
+		if (events.size() >= MAX_EVENTS)
+			return;
+		Event e = { name, cat, ph, ts, dur, threadId };
+		events.push_back(e);
+	}
+	static std::string escape(const std::string& s) {
+		std::string ret;
+		for (auto it=s.begin(); it!=s.end(); ++it) {
+			if (*it == '"' || *it == '\\')
+				ret += '\\';
+			if ((unsigned char) *it < 0x20)
+				ret += ' ';
+			else
+				ret += *it;
+		}
+		return ret;
+	}
+public:
+	Profiler() : start(Clock::now()), gpuFrame(0), gpuTiming(false), gpuOffset(0), droppedGpuFrames(0) {}
+	double now() const {
+		return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+	}
+	void nameThread(const char* name) {
+		std::lock_guard<std::mutex> lock(mutex);
+		threadNames[tid()-1] = name;
+	}
+	void complete(const std::string& name, double begin, double end) {
+		std::lock_guard<std::mutex> lock(mutex);
+		record(name, "cpu", 'X', begin, end-begin, tid());
+	}
+	void instant(const std::string& name) {
+		double ts = now();
+		std::lock_guard<std::mutex> lock(mutex);
+		record(name, "gl", 'i', ts, 0, tid());
+	}
+	// needs a current context; lines the GPU clock up with ours
+	void initGpu() {
+		for (int f=0; f<FRAMES_IN_FLIGHT; f++) {
+			glGenQueries(2*MAX_GPU_SCOPES, gpuFrames[f].queries);
+			gpuFrames[f].used = 0;
+		}
+		GLint64 gpuNow = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+		gpuOffset = now() - gpuNow/1000.0;
+		gpuTiming = true;
+	}
+	void releaseGpu() {
+		if (!gpuTiming)
+			return;
+		for (int f=0; f<FRAMES_IN_FLIGHT; f++)
+			glDeleteQueries(2*MAX_GPU_SCOPES, gpuFrames[f].queries);
+		gpuTiming = false;
+	}
+	// Collects the GPU timings of the oldest frame in flight and reuses its queries.
+	// Results that still aren't there are dropped rather than waited for.
+	void beginFrame() {
+		if (!gpuTiming)
+			return;
+		gpuFrame = (gpuFrame+1) % FRAMES_IN_FLIGHT;
+		GpuFrame& f = gpuFrames[gpuFrame];
+		if (f.used > 0) {
+			GLint available = 0;
+			glGetQueryObjectiv(f.queries[2*f.used-1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint64 stamps[2*MAX_GPU_SCOPES];
+				for (int i=0; i<2*f.used; i++) {
+					stamps[i] = 0;
+					glGetQueryObjectui64v(f.queries[i], GL_QUERY_RESULT, &stamps[i]);
+				}
+				std::lock_guard<std::mutex> lock(mutex);
+				for (int i=0; i<f.used; i++) {
+					GLuint64 begin = stamps[2*i], end = stamps[2*i+1];
+					record(f.names[i], "gpu", 'X', begin/1000.0 + gpuOffset, (end-begin)/1000.0, GPU_TID);
+				}
+			} else {
+				droppedGpuFrames++;
+			}
+		}
+		f.used = 0;
+	}
+	// render thread only; returns -1 if there is no query left this frame
+	int gpuBegin(const char* name) {
+		GpuFrame& f = gpuFrames[gpuFrame];
+		if (!gpuTiming || f.used == MAX_GPU_SCOPES)
+			return -1;
+		glQueryCounter(f.queries[2*f.used], GL_TIMESTAMP);
+		f.names[f.used] = name;
+		return f.used++;
+	}
+	void gpuEnd(int scope) {
+		if (scope >= 0)
+			glQueryCounter(gpuFrames[gpuFrame].queries[2*scope+1], GL_TIMESTAMP);
+	}
+	bool write(const char* filename) {
+		std::lock_guard<std::mutex> lock(mutex);
+		FILE* out = fopen(filename, "w");
+		if (out == NULL)
+			return false;
+		fprintf(out, "{\"traceEvents\":[\n");
+		fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", GPU_TID);
+		for (size_t i=0; i<threadNames.size(); i++)
+			fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				int(i+1), escape(threadNames[i]).c_str());
+		for (auto it=events.begin(); it!=events.end(); ++it) {
+			fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+				escape(it->name).c_str(), it->cat, it->ph, it->ts, it->tid);
+			if (it->ph == 'X')
+				fprintf(out, ",\"dur\":%.3f}", it->dur);
+			else
+				fprintf(out, ",\"s\":\"t\"}");
+		}
+		fprintf(out, "\n]}\n");
+		fclose(out);
+		printf("Wrote %u trace events to %s (%u frames of GPU timings dropped)\n",
+			unsigned(events.size()), filename, droppedGpuFrames);
+		return true;
+	}
+};
+Profiler profiler;
+
+// Times the enclosing block on the CPU.
+class CpuScope {
+private:
+	std::string name;
+	double begin;
+public:
+	explicit CpuScope(const std::string& n) : name(n), begin(profiler.now()) {}
+	~CpuScope() {
+		profiler.complete(name, begin, profiler.now());
+	}
+};
+
+// Times the GL commands issued in the enclosing block on the GPU. Render thread only.
+class GpuScope {
+private:
+	int scope;
+public:
+	explicit GpuScope(const char* name) : scope(profiler.gpuBegin(name)) {}
+	~GpuScope() {
+		profiler.gpuEnd(scope);
+	}
+};
+
+// Reports GL errors as the driver notices them, instead of polling glGetError() every frame.
+static void APIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity,
+		GLsizei length, const GLchar* message, const void* userParam) {
+	if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+		return;
+	fprintf(stderr, "OpenGL %s (source 0x%x, type 0x%x, id %u): %s\n",
+		type == GL_DEBUG_TYPE_ERROR ? "Error" : "message", source, type, id, message);
+	profiler.instant(message);
+}
+
+// Preprocessor definitions injected into every stage of a shader program, right after
+// the #version line. Ordered by name, so equal sets always map to the same variant.
+typedef std::map<std::string, std::string> ShaderDefines;
+
 class ShaderProgram {
+public:
+	struct Stage {
+		GLenum type;
+		std::string filename;
+		std::string source;
+	};
 private:
-	GLuint programID;
-	void compileShader(GLuint shaderID, std::string src) {
+	std::vector<Stage> stages;
+	// every define set requested so far and the program compiled for it
+	std::map<ShaderDefines, GLuint> variants;
+	unsigned int lookups;
+	unsigned int compiles;
+	// "#version" has to stay the first statement, so the defines go on the line after it.
+	// A #line directive after them keeps compiler errors pointing at the lines of the file.
+	static std::string injectDefines(const std::string& src, const ShaderDefines& defines) {
+		std::string block;
+		for (auto it=defines.begin(); it!=defines.end(); ++it)
+			block += "#define " + it->first + " " + it->second + "\n";
+		size_t pos = src.find("#version");
+		if (pos == std::string::npos)
+			return block + "#line 0\n" + src;
+		int version = atoi(src.c_str() + pos + strlen("#version"));
+		// 1-based number of the first line after #version
+		int next = std::count(src.begin(), src.begin()+pos, '\n') + 2;
+		pos = src.find('\n', pos);
+		if (pos == std::string::npos)
+			return src + "\n" + block;
+		// up to GLSL 4.10 "#line n" numbers the following line n+1, from 4.20 on n like C
+		int line = version >= 420 ? next : next-1;
+		return src.substr(0, pos+1) + block + "#line " + std::to_string(line) + "\n" + src.substr(pos+1);
+	}
+	bool compileShader(GLuint shaderID, std::string src) {
 		GLint Result = GL_FALSE;
 		int InfoLogLength;
 		char const * srcptr = src.c_str();
@@ -53,24 +312,21 @@ private:
 			glGetShaderInfoLog(shaderID, InfoLogLength, NULL, &errormsg[0]);
 			printf("%s\n", &errormsg[0]);
 		}
+		return Result == GL_TRUE;
 	}
-	GLuint LoadShader(GLenum shaderType, const char * filename) {
-		GLuint shaderId = glCreateShader(shaderType);
-		std::string code = getFileContents(filename);
-		compileShader(shaderId, code);
-		return shaderId;
-	}
-public:
-	ShaderProgram() {
-		programID = glCreateProgram();
-	}
-	void addShader(GLenum shaderType, const char * filename) {
-		std::cout << "Loading shader from " << filename << std::endl;
-		GLuint newShader = LoadShader(shaderType, filename);
-		glAttachShader(programID, newShader);
-		glDeleteShader(newShader);
-	}
-	GLuint finalize() {
+	// returns 0 if any stage fails to compile or the program fails to link
+	GLuint build(const ShaderDefines& defines) {
+		GLuint programID = glCreateProgram();
+		bool ok = true;
+		for (auto it=stages.begin(); it!=stages.end(); ++it) {
+			std::cout << "Compiling shader " << it->filename << std::endl;
+			CpuScope timing("compile " + it->filename);
+			GLuint shaderId = glCreateShader(it->type);
+			ok = compileShader(shaderId, injectDefines(it->source, defines)) && ok;
+			glAttachShader(programID, shaderId);
+			glDeleteShader(shaderId);
+		}
+		CpuScope timing("link");
 		glLinkProgram(programID);
 		GLint Result = GL_FALSE;
 		int InfoLogLength;
@@ -81,16 +337,528 @@ public:
 			glGetProgramInfoLog(programID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 			fprintf(stderr,"%s\n", &ProgramErrorMessage[0]);
 		}
+		compiles++;
+		if (!ok || Result != GL_TRUE) {
+			glDeleteProgram(programID);
+			return 0;
+		}
 		return programID;
 	}
+public:
+	ShaderProgram() : lookups(0), compiles(0) {}
+	ShaderProgram(const ShaderProgram&) = delete;
+	ShaderProgram& operator=(const ShaderProgram&) = delete;
+	~ShaderProgram() {
+		for (auto it=variants.begin(); it!=variants.end(); ++it)
+			glDeleteProgram(it->second);
+	}
+	// The source is read once here; compiling is deferred until a variant is requested.
+	void addShader(GLenum shaderType, const char * filename) {
+		std::cout << "Loading shader from " << filename << std::endl;
+		addSource(shaderType, filename, getFileContents(filename));
+	}
+	void addSource(GLenum shaderType, const std::string& filename, const std::string& source) {
+		Stage stage = { shaderType, filename, source };
+		stages.push_back(stage);
+	}
+	const std::vector<Stage>& getStages() const {
+		return stages;
+	}
+	// Returns the program specialized for the given defines, compiling it on first use.
+	// A variant that failed to build is remembered as 0.
+	GLuint variant(const ShaderDefines& defines) {
+		lookups++;
+		auto search = variants.find(defines);
+		if (search != variants.end())
+			return search->second;
+		GLuint programID = build(defines);
+		variants.insert(std::make_pair(defines, programID));
+		return programID;
+	}
+	// Returns the variant if it was built successfully before, 0 otherwise. Never compiles.
+	GLuint cached(const ShaderDefines& defines) {
+		auto search = variants.find(defines);
+		if (search == variants.end() || search->second == 0)
+			return 0;
+		lookups++;
+		return search->second;
+	}
+	// the variant without any defines
+	GLuint finalize() {
+		return variant(ShaderDefines());
+	}
+	// counts the work done by a program this one replaces, so the stats cover the whole run
+	void addStats(const ShaderProgram& other) {
+		lookups += other.lookups;
+		compiles += other.compiles;
+	}
+	void printStats(const char* name) const {
+		unsigned int hits = lookups - compiles;
+		printf("%s shader variants: %u compiled, %u lookups, %.1f%% cache hits\n",
+			name, compiles, lookups, lookups ? 100.0 * hits / lookups : 0.0);
+	}
+};
+
+#ifdef __linux__
+// Watches the files of a ShaderProgram with inotify and rebuilds the program on a
+// background thread, using a hidden context that shares objects with the render context.
+// The render thread picks the result up with take() at a frame boundary, which never
+// blocks on disk I/O or compiling. A program that fails to build is never handed over.
+class ShaderReloader {
+private:
+	typedef std::chrono::steady_clock Clock;
+	GLFWwindow* context;
+	std::vector<ShaderProgram::Stage> stages; // sources left empty, only type and filename
+	std::thread worker;
+	int inotifyFd;
+	std::atomic<bool> stopping;
+	std::mutex mutex;
+	// guarded by mutex
+	ShaderDefines active;
+	ShaderProgram* pending;
+	ShaderDefines pendingDefines;
+	Clock::time_point changedAt;
+	double readyMs;
+	std::atomic<bool> ready;
+	// rebuild from disk without waiting for a file change
+	std::atomic<bool> rebuildRequested;
+
+	static std::string dirName(const std::string& path) {
+		size_t slash = path.rfind('/');
+		return slash == std::string::npos ? "." : path.substr(0, slash);
+	}
+	static std::string baseName(const std::string& path) {
+		size_t slash = path.rfind('/');
+		return slash == std::string::npos ? path : path.substr(slash+1);
+	}
+	// true if the inotify events in buf name one of our files
+	bool touchesStage(const char* buf, ssize_t len) const {
+		for (const char* p=buf; p<buf+len; ) {
+			const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+			if (ev->len > 0)
+				for (auto it=stages.begin(); it!=stages.end(); ++it)
+					if (baseName(it->filename) == ev->name)
+						return true;
+			p += sizeof(inotify_event) + ev->len;
+		}
+		return false;
+	}
+	ShaderProgram* rebuild(const ShaderDefines& defines) {
+		ShaderProgram* fresh = new ShaderProgram();
+		for (auto it=stages.begin(); it!=stages.end(); ++it) {
+			std::string source;
+			if (!readFile(it->filename.c_str(), source)) {
+				fprintf(stderr, "Can't read %s, keeping the old shaders\n", it->filename.c_str());
+				delete fresh;
+				return NULL;
+			}
+			fresh->addSource(it->type, it->filename, source);
+		}
+		if (fresh->variant(defines) == 0) {
+			fprintf(stderr, "Shader reload failed, keeping the old shaders\n");
+			delete fresh;
+			return NULL;
+		}
+		// the render context must see a fully built program
+		glFinish();
+		return fresh;
+	}
+	void run() {
+		profiler.nameThread("shader loader");
+		glfwMakeContextCurrent(context);
+		alignas(inotify_event) char buf[4096];
+		pollfd fds[1] = { { inotifyFd, POLLIN, 0 } };
+		while (!stopping.load(std::memory_order_relaxed)) {
+			Clock::time_point noticed = Clock::now();
+			if (!rebuildRequested.exchange(false)) {
+				// wake up now and then to notice the destructor or setActive() asking for us
+				if (poll(fds, 1, 100) <= 0)
+					continue;
+				ssize_t len = read(inotifyFd, buf, sizeof(buf));
+				if (len <= 0 || !touchesStage(buf, len))
+					continue;
+				noticed = Clock::now();
+				// editors tend to save in several steps; wait until the directory is quiet
+				while (poll(fds, 1, 20) > 0)
+					if (read(inotifyFd, buf, sizeof(buf)) <= 0)
+						break;
+			}
+			ShaderDefines defines;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				defines = active;
+			}
+			ShaderProgram* fresh = rebuild(defines);
+			if (fresh == NULL)
+				continue;
+			double ms = std::chrono::duration<double, std::milli>(Clock::now() - noticed).count();
+			ShaderProgram* stale;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stale = pending;
+				pending = fresh;
+				pendingDefines = defines;
+				changedAt = noticed;
+				readyMs = ms;
+				ready.store(true, std::memory_order_release);
+			}
+			// a newer build came in before the render thread took the previous one
+			delete stale;
+		}
+		glfwMakeContextCurrent(NULL);
+	}
+public:
+	// shared has to be created on the main thread, sharing with the render window
+	ShaderReloader(GLFWwindow* shared, const ShaderProgram& program, const ShaderDefines& defines)
+		: context(shared), inotifyFd(inotify_init1(IN_NONBLOCK)), stopping(false),
+		  active(defines), pending(NULL), readyMs(0), ready(false), rebuildRequested(false) {
+		for (auto it=program.getStages().begin(); it!=program.getStages().end(); ++it) {
+			ShaderProgram::Stage stage = { it->type, it->filename, "" };
+			stages.push_back(stage);
+		}
+		if (inotifyFd < 0) {
+			fprintf(stderr, "Shader hot-reload unavailable\n");
+			return;
+		}
+		for (auto it=stages.begin(); it!=stages.end(); ++it)
+			inotify_add_watch(inotifyFd, dirName(it->filename).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		worker = std::thread(&ShaderReloader::run, this);
+	}
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+	~ShaderReloader() {
+		stopping.store(true, std::memory_order_relaxed);
+		if (worker.joinable())
+			worker.join();
+		delete pending;
+		if (inotifyFd >= 0)
+			close(inotifyFd);
+	}
+	// The define set the render thread is currently using, built first on a change.
+	// With rebuild set the sources are rebuilt for it right away.
+	void setActive(const ShaderDefines& defines, bool rebuild = false) {
+		std::lock_guard<std::mutex> lock(mutex);
+		active = defines;
+		if (rebuild)
+			rebuildRequested.store(true);
+	}
+	// Returns the rebuilt program if one is ready, NULL otherwise. The caller owns it.
+	// built is set to the defines of the variant that was compiled and checked.
+	ShaderProgram* take(ShaderDefines& built) {
+		if (!ready.load(std::memory_order_acquire))
+			return NULL;
+		std::lock_guard<std::mutex> lock(mutex);
+		ShaderProgram* fresh = pending;
+		built = pendingDefines;
+		pending = NULL;
+		ready.store(false, std::memory_order_relaxed);
+		double latency = std::chrono::duration<double, std::milli>(Clock::now() - changedAt).count();
+		printf("Reloaded shaders: built %.1f ms and ready %.1f ms after the change\n", readyMs, latency);
+		return fresh;
+	}
+};
+#else
+// inotify is Linux only; elsewhere the shaders are loaded once at startup
+class ShaderReloader {
+public:
+	ShaderReloader(GLFWwindow*, const ShaderProgram&, const ShaderDefines&) {}
+	void setActive(const ShaderDefines&, bool = false) {}
+	ShaderProgram* take(ShaderDefines&) { return NULL; }
+};
+#endif
+
+// Swaps in a program the reloader has rebuilt, if it was built for the wanted defines.
+// Otherwise the old program stays and the reloader is asked to build for those defines.
+// Returns true if the program was swapped.
+bool swapReloaded(ShaderReloader* reloader, ShaderProgram*& program, GLuint& shader, const ShaderDefines& defines) {
+	ShaderDefines built;
+	ShaderProgram* reloaded = reloader->take(built);
+	if (reloaded == NULL)
+		return false;
+	GLuint fresh = built == defines ? reloaded->variant(defines) : 0;
+	if (fresh == 0) {
+		program->addStats(*reloaded);
+		delete reloaded;
+		reloader->setActive(defines, true);
+		return false;
+	}
+	reloaded->addStats(*program);
+	delete program;
+	program = reloaded;
+	shader = fresh;
+	return true;
+}
+
+// specializes the geometry shader for a full ring of the given number of segments
+static ShaderDefines segmentDefines(int segments) {
+	ShaderDefines defines;
+	defines["MAXSEGMENTS"] = std::to_string(segments);
+	defines["MAX_VERTICES"] = std::to_string(2*segments+2);
+	return defines;
+}
+
+// Mean, deviation and worst case of a series of intervals in milliseconds.
+struct Jitter {
+	int count;
+	double sum, sumSq, worst;
+	Jitter() { reset(); }
+	void reset() {
+		count = 0;
+		sum = sumSq = worst = 0.0;
+	}
+	void add(double ms) {
+		count++;
+		sum += ms;
+		sumSq += ms*ms;
+		worst = std::max(worst, ms);
+	}
+	double mean() const {
+		return count ? sum/count : 0.0;
+	}
+	double deviation() const {
+		return count ? std::sqrt(std::max(0.0, sumSq/count - mean()*mean())) : 0.0;
+	}
+};
+
+// Hands snapshots from one writer thread to one reader thread without locking.
+// The writer never waits, and the reader always gets the newest complete snapshot.
+template<class T>
+class TripleBuffer {
+private:
+	static const unsigned FRESH = 4; // set while the middle slot holds an unread snapshot
+	T slots[3];
+	std::atomic<unsigned> middle;
+	unsigned back;  // only touched by the writer
+	unsigned front; // only touched by the reader
+public:
+	TripleBuffer() : middle(1), back(0), front(2) {}
+	T& writeSlot() {
+		return slots[back];
+	}
+	void publish() {
+		back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & 3;
+	}
+	// true if a newer snapshot was published since the last call
+	bool update() {
+		if (!(middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+		return true;
+	}
+	const T& read() const {
+		return slots[front];
+	}
+};
+
+// How often the simulation steps; offset grows by the old per-frame amount each tick.
+static const double TICK = 1.0/60.0;
+
+// What the simulation thread publishes every tick. Never changed once published.
+struct Snapshot {
+	double time;    // simulated seconds since the start
+	Clock::time_point published;
+	float offset;   // ring rotation in degrees, also drives the segment count
+	Jitter tick;    // intervals between the ticks of the last second
+};
+
+// The simulation thread: steps at a fixed rate, independent of how fast frames are drawn.
+static void simulate(TripleBuffer<Snapshot>* out, const std::atomic<bool>* running, Clock::time_point start) {
+	profiler.nameThread("simulation");
+	Snapshot state;
+	state.time = 0.0;
+	state.offset = 0.0f;
+	Jitter ticks;
+	Clock::duration step = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(TICK));
+	Clock::time_point next = start, last = start;
+	for (long tick=0; running->load(std::memory_order_relaxed); tick++) {
+		double tickBegin = profiler.now();
+		state.offset += 1.f;
+		state.time = tick*TICK;
+		Clock::time_point now = Clock::now();
+		ticks.add(msBetween(last, now));
+		last = now;
+		if (ticks.count == 60) {
+			state.tick = ticks;
+			ticks.reset();
+		}
+		state.published = now;
+		out->writeSlot() = state;
+		out->publish();
+		profiler.complete("tick", tickBegin, profiler.now());
+		next += step;
+		// after a long stall (e.g. a debugger) don't try to catch up tick by tick
+		if (Clock::now() - next > 15*step)
+			next = Clock::now();
+		std::this_thread::sleep_until(next);
+	}
+}
+
+// A ring of per-frame regions in one GL buffer that vertices are written straight into.
+// With ARB_buffer_storage the buffer is mapped once, persistently and coherently, and a
+// fence per region keeps the CPU from overwriting what the GPU may still read. Plain GL 3.3
+// maps each allocation unsynchronized instead and orphans the buffer whenever the ring
+// wraps, which leaves the fencing to the driver.
+class StreamBuffer {
+private:
+	static const int REGIONS = 3;
+	GLenum target;
+	GLuint buffer;
+	size_t regionSize;
+	bool persistent;
+	char* mapped;           // the whole buffer, persistent path only
+	bool mappedRange;       // an allocation is mapped, fallback path only
+	GLsync fences[REGIONS];
+	int region;
+	size_t used;            // bytes handed out from the current region
+	size_t bytes;           // written since the last resetStats()
+	double stallMs;         // waited on fences, orphaning or mapping since the last resetStats()
+public:
+	StreamBuffer(GLenum bufferTarget, size_t bytesPerFrame)
+		: target(bufferTarget), regionSize(bytesPerFrame), persistent(GLEW_ARB_buffer_storage != 0),
+		  mapped(NULL), mappedRange(false), region(0), used(0), bytes(0), stallMs(0) {
+		for (int i=0; i<REGIONS; i++)
+			fences[i] = 0;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(target, buffer);
+		if (persistent) {
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(target, REGIONS*regionSize, NULL, flags);
+			mapped = static_cast<char*>(glMapBufferRange(target, 0, REGIONS*regionSize, flags));
+			if (mapped == NULL) {
+				// storage is immutable, so falling back needs a fresh buffer
+				glDeleteBuffers(1, &buffer);
+				glGenBuffers(1, &buffer);
+				glBindBuffer(target, buffer);
+				persistent = false;
+			}
+		}
+		if (!persistent)
+			glBufferData(target, REGIONS*regionSize, NULL, GL_STREAM_DRAW);
+		printf("Streaming vertices through a %s buffer\n", persistent ? "persistently mapped" : "orphaned");
+	}
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+	~StreamBuffer() {
+		for (int i=0; i<REGIONS; i++)
+			if (fences[i])
+				glDeleteSync(fences[i]);
+		glBindBuffer(target, buffer);
+		if (persistent || mappedRange)
+			glUnmapBuffer(target);
+		glDeleteBuffers(1, &buffer);
+	}
+	GLuint id() const {
+		return buffer;
+	}
+	// Returns where to write `size` bytes this frame, and sets offset to their place in the
+	// buffer. NULL if the frame's region is full or can't be mapped. Leaves the buffer
+	// bound to the target.
+	void* allocate(size_t size, GLintptr& offset) {
+		if (used + size > regionSize)
+			return NULL;
+		offset = region*regionSize + used;
+		glBindBuffer(target, buffer);
+		void* ret;
+		if (persistent) {
+			if (used == 0 && fences[region]) {
+				// the GPU should be done with this region since REGIONS-1 frames
+				Clock::time_point before = Clock::now();
+				GLenum state;
+				do {
+					state = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+				} while (state == GL_TIMEOUT_EXPIRED);
+				stallMs += msBetween(before, Clock::now());
+				glDeleteSync(fences[region]);
+				fences[region] = 0;
+			}
+			ret = mapped + offset;
+		} else {
+			// the driver does its waiting in here, if any
+			Clock::time_point before = Clock::now();
+			if (used == 0 && region == 0)
+				glBufferData(target, REGIONS*regionSize, NULL, GL_STREAM_DRAW);
+			ret = glMapBufferRange(target, offset, size,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+			stallMs += msBetween(before, Clock::now());
+			// e.g. GL_OUT_OF_MEMORY; nothing is mapped, so there is nothing to unmap either
+			if (ret == NULL)
+				return NULL;
+			mappedRange = true;
+		}
+		used += size;
+		bytes += size;
+		return ret;
+	}
+	// Call after writing, before drawing from the allocation.
+	void flush() {
+		if (mappedRange) {
+			glBindBuffer(target, buffer);
+			glUnmapBuffer(target);
+			mappedRange = false;
+		}
+	}
+	// Call after the last draw of the frame reading from this buffer.
+	void endFrame() {
+		if (used == 0)
+			return;
+		if (persistent)
+			fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		region = (region+1) % REGIONS;
+		used = 0;
+	}
+	size_t bytesWritten() const {
+		return bytes;
+	}
+	double stalled() const {
+		return stallMs;
+	}
+	void resetStats() {
+		bytes = 0;
+		stallMs = 0;
+	}
 };
 
+// quads per circle line the geometry shader emits; it closes the ring only once it is complete
+static int ringQuads(int segcount, int maxsegments) {
+	return segcount == maxsegments ? maxsegments : std::max(0, segcount-1);
+}
+
+// Writes the triangles the geometry shader would emit for segcount segments, for every line
+// of the circle, as a triangle list: 6*ringQuads() vertices per line.
+static void writeRing(GLfloat* out, const GLfloat* circle, int circleVertices, int segcount, int maxsegments) {
+	const int quads = ringQuads(segcount, maxsegments);
+	GLfloat* p = out;
+	for (int i=0; i<circleVertices; i++) {
+		const GLfloat* v0 = circle + 3*i;
+		const GLfloat* v1 = circle + 3*((i+1) % circleVertices);
+		float c0 = 1.0f, s0 = 0.0f;
+		for (int q=0; q<quads; q++) {
+			float angle = (q+1) * 2 * 3.14159f / maxsegments;
+			float c1 = cos(angle), s1 = sin(angle);
+			// the strip in0, out0, in1, out1 as two triangles with the strip's winding
+			const float corners[6][3] = {
+				{ c0*v0[0], v0[1], s0*v0[0] }, { c0*v1[0], v1[1], s0*v1[0] }, { c1*v0[0], v0[1], s1*v0[0] },
+				{ c1*v0[0], v0[1], s1*v0[0] }, { c0*v1[0], v1[1], s0*v1[0] }, { c1*v1[0], v1[1], s1*v1[0] },
+			};
+			for (int k=0; k<6; k++) {
+				*p++ = corners[k][0];
+				*p++ = corners[k][1];
+				*p++ = corners[k][2];
+			}
+			c0 = c1;
+			s0 = s1;
+		}
+	}
+}
+
 // An array of 3 vectors which represents 3 vertices
 static const int NUM_CIRCLE_VERTICES = 50;
 static GLfloat g_vertex_buffer_data[3*NUM_CIRCLE_VERTICES];
 
 int main( void )
 {
+	double initBegin = profiler.now();
+	profiler.nameThread("render");
 	for (int i=0; i<NUM_CIRCLE_VERTICES; i++) {
 		float f = i * 2*M_PI / NUM_CIRCLE_VERTICES;
 		g_vertex_buffer_data[3*i] = cos(f)+2.0f;
@@ -109,6 +877,7 @@ int main( void )
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
 
 	// Open a window and create its OpenGL context
 	window = glfwCreateWindow( 1024, 768, "Tutorial 01", NULL, NULL);
@@ -124,6 +893,16 @@ int main( void )
 	}
 	glfwMakeContextCurrent(window);
 
+	// hidden contexts for building shaders off the render thread, one per reloader
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	GLFWwindow* loaderContext = glfwCreateWindow(1, 1, "shader loader", NULL, window);
+	GLFWwindow* ringLoaderContext = glfwCreateWindow(1, 1, "ring shader loader", NULL, window);
+	if (loaderContext == NULL || ringLoaderContext == NULL) {
+		fprintf(stderr, "Failed to create the shader loader context\n");
+		glfwTerminate();
+		return -1;
+	}
+
 	GLenum error = glGetError();
 	if (error != GL_NO_ERROR)
 	{
@@ -144,6 +923,15 @@ int main( void )
 	    fprintf(stderr, "0 OpenGL Error: %d\n", error);
 	}
 
+	// with KHR_debug errors are reported as they happen; otherwise poll once a frame
+	bool debugOutput = GLEW_KHR_debug != 0;
+	if (debugOutput) {
+		glEnable(GL_DEBUG_OUTPUT);
+		glDebugMessageCallback(debugMessage, NULL);
+	}
+	profiler.initGpu();
+	profiler.complete("init", initBegin, profiler.now());
+
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
@@ -168,14 +956,48 @@ int main( void )
 	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
 	 
 	// Give our vertices to OpenGL.
+	double uploadBegin = profiler.now();
 	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
+	profiler.complete("upload", uploadBegin, profiler.now());
 
 	// load shaders
-	ShaderProgram shaderProgram;
-	shaderProgram.addShader(GL_VERTEX_SHADER, "vertex");
-	shaderProgram.addShader(GL_FRAGMENT_SHADER, "fragment");
-	shaderProgram.addShader(GL_GEOMETRY_SHADER, "geometry");
-	GLuint shader = shaderProgram.finalize();
+	ShaderProgram* shaderProgram = new ShaderProgram();
+	shaderProgram->addShader(GL_VERTEX_SHADER, "vertex");
+	shaderProgram->addShader(GL_FRAGMENT_SHADER, "fragment");
+	shaderProgram->addShader(GL_GEOMETRY_SHADER, "geometry");
+
+	// the geometry shader is specialized for the number of segments a full ring has
+	static const int SEGMENT_OPTIONS[] = { 20, 40, 80 };
+	static const int NUM_SEGMENT_OPTIONS = sizeof(SEGMENT_OPTIONS)/sizeof(SEGMENT_OPTIONS[0]);
+	int segmentOption = NUM_SEGMENT_OPTIONS-1;
+	int MAXSEGMENTS = SEGMENT_OPTIONS[segmentOption];
+	ShaderDefines defines = segmentDefines(MAXSEGMENTS);
+	GLuint shader = shaderProgram->variant(defines);
+#ifndef __linux__
+	// there are no background builds here, so build every segment count up front
+	for (int i=0; i<NUM_SEGMENT_OPTIONS; i++)
+		shaderProgram->variant(segmentDefines(SEGMENT_OPTIONS[i]));
+#endif
+	// the segment count asked for with space bar; drawn once its variant is built
+	int wantedOption = segmentOption;
+	ShaderDefines wanted = defines;
+	bool canSwitch = true;
+	ShaderReloader* reloader = new ShaderReloader(loaderContext, *shaderProgram, defines);
+
+	// the same ring built on the CPU every frame and streamed to the GPU, toggled with G
+	ShaderProgram* ringProgram = new ShaderProgram();
+	ringProgram->addShader(GL_VERTEX_SHADER, "vertex");
+	ringProgram->addShader(GL_FRAGMENT_SHADER, "fragment");
+	ShaderDefines ringDefines;
+	ringDefines["APPLY_MVP"] = "1";
+	GLuint ringShader = ringProgram->variant(ringDefines);
+	ShaderReloader* ringReloader = new ShaderReloader(ringLoaderContext, *ringProgram, ringDefines);
+	const int maxRingOption = SEGMENT_OPTIONS[NUM_SEGMENT_OPTIONS-1];
+	StreamBuffer* stream = new StreamBuffer(GL_ARRAY_BUFFER,
+		NUM_CIRCLE_VERTICES * 6*ringQuads(maxRingOption, maxRingOption) * 3*sizeof(GLfloat));
+	bool cpuRing = false;
+	bool canToggle = true;
+	double ringWriteMs = 0.0;
 	
 	// matrices
 	glm::mat4 projection = glm::perspective(45.0f, 4.0f/3.0f, 0.1f, 100.0f);
@@ -192,51 +1014,175 @@ int main( void )
 	glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
 
-	float offset = 0.0f;
+	// the simulation runs on its own thread; frames blend the two newest snapshots
+	TripleBuffer<Snapshot> snapshots;
+	std::atomic<bool> simulating(true);
+	Clock::time_point start = Clock::now();
+	std::thread simulation(simulate, &snapshots, &simulating, start);
+	while (!snapshots.update())
+		std::this_thread::yield();
+	Snapshot prev = snapshots.read(), curr = prev;
+	Jitter frames, ages;
+	Clock::time_point lastFrame = Clock::now(), lastReport = lastFrame;
+
 	do{
-		offset += 1.f;
-		// clear screen
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        // actually use our shaders
-		glUseProgram(shader);
-		glm::mat4 rotation = glm::rotate(glm::mat4(1.0f),offset,glm::vec3(0,1,0));
-        glm::mat4 MVP = MVP0 * rotation;
-		// set offset in shader
-		GLint offsetloc = glGetUniformLocation(shader,"offset");
-		glUniform1f(offsetloc,offset);
-		GLuint MVPloc = glGetUniformLocation(shader,"MVP");
-		GLint segcntloc = glGetUniformLocation(shader,"segcount");
-		int MAXSEGMENTS = 80;
-		int segments = ((int) offset) % (2*MAXSEGMENTS);
-		if (segments > MAXSEGMENTS)
-			segments = 2*MAXSEGMENTS-segments;
-		glUniform1i(segcntloc,segments);
-		glUniformMatrix4fv(MVPloc, 1, GL_FALSE, &MVP[0][0]);
-		// some gl magic; look it up.
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(
-			0,                  // attribute 0. No particular reason for 0, but must match the layout in the shader.
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-		);
-		glDrawArrays(GL_LINE_LOOP, 0, NUM_CIRCLE_VERTICES);
-		glDisableVertexAttribArray(0);
+		CpuScope frameTiming("frame");
+		profiler.beginFrame();
+		if (snapshots.update()) {
+			prev = curr;
+			curr = snapshots.read();
+		}
+		// draw one tick in the past, so there is always a newer snapshot to blend towards
+		Clock::time_point now = Clock::now();
+		// measured from the newest snapshot, not from start: after a long stall the
+		// simulation skips ahead and its time no longer matches the wall clock
+		double simNow = curr.time + msBetween(curr.published, now)/1000.0 - TICK;
+		float alpha = 1.0f;
+		if (curr.time > prev.time)
+			alpha = std::min(1.0, std::max(0.0, (simNow - prev.time) / (curr.time - prev.time)));
+		ages.add(msBetween(curr.published, now));
+		frames.add(msBetween(lastFrame, now));
+		lastFrame = now;
+		if (msBetween(lastReport, now) >= 1000.0) {
+			printf("frame %.2f ms +-%.2f (worst %.2f) | tick %.2f ms +-%.3f (worst %.2f) | snapshot age %.2f ms (worst %.2f)\n",
+				frames.mean(), frames.deviation(), frames.worst,
+				curr.tick.mean(), curr.tick.deviation(), curr.tick.worst,
+				ages.mean(), ages.worst);
+			if (cpuRing) {
+				double mb = stream->bytesWritten() / 1e6;
+				printf("ring streaming: %.1f MB/s, %.0f MB/s while writing, %.2f ms stalled\n",
+					mb / (msBetween(lastReport, now)/1000.0), ringWriteMs > 0 ? mb / (ringWriteMs/1000.0) : 0.0,
+					stream->stalled());
+			}
+			stream->resetStats();
+			ringWriteMs = 0.0;
+			frames.reset();
+			ages.reset();
+			lastReport = now;
+		}
+		// swap in shaders rebuilt since the last frame
+		if (swapReloaded(reloader, shaderProgram, shader, wanted) && wanted != defines) {
+			defines = wanted;
+			segmentOption = wantedOption;
+			MAXSEGMENTS = SEGMENT_OPTIONS[segmentOption];
+			printf("%d segments\n", MAXSEGMENTS);
+		}
+		swapReloaded(ringReloader, ringProgram, ringShader, ringDefines);
+		float offset = prev.offset + (curr.offset - prev.offset)*alpha;
+		{
+			// everything up to the swap, as the GPU sees it; closed before the swap so
+			// the present and any vsync wait stay out of it
+			GpuScope gpuTiming("frame");
+			// clear screen
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			// actually use our shaders
+			GLuint program = cpuRing ? ringShader : shader;
+			glUseProgram(program);
+			glm::mat4 rotation = glm::rotate(glm::mat4(1.0f),offset,glm::vec3(0,1,0));
+			glm::mat4 MVP = MVP0 * rotation;
+			// set offset in shader
+			GLint offsetloc = glGetUniformLocation(program,"offset");
+			glUniform1f(offsetloc,offset);
+			GLuint MVPloc = glGetUniformLocation(program,"MVP");
+			GLint segcntloc = glGetUniformLocation(program,"segcount");
+			int segments = ((int) offset) % (2*MAXSEGMENTS);
+			if (segments > MAXSEGMENTS)
+				segments = 2*MAXSEGMENTS-segments;
+			glUniform1i(segcntloc,segments);
+			glUniformMatrix4fv(MVPloc, 1, GL_FALSE, &MVP[0][0]);
+			// some gl magic; look it up.
+			glEnableVertexAttribArray(0);
+			if (cpuRing) {
+				// write the ring straight into this frame's part of the mapped buffer
+				int ringVertices = NUM_CIRCLE_VERTICES * 6*ringQuads(segments, MAXSEGMENTS);
+				GLintptr ringOffset = 0;
+				GLfloat* ring = ringVertices > 0 ? static_cast<GLfloat*>(
+					stream->allocate(ringVertices * 3*sizeof(GLfloat), ringOffset)) : NULL;
+				if (ring != NULL) {
+					double writeBegin = profiler.now();
+					writeRing(ring, g_vertex_buffer_data, NUM_CIRCLE_VERTICES, segments, MAXSEGMENTS);
+					double writeEnd = profiler.now();
+					profiler.complete("write ring", writeBegin, writeEnd);
+					ringWriteMs += (writeEnd - writeBegin)/1000.0;
+					stream->flush();
+					glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)ringOffset);
+					glDrawArrays(GL_TRIANGLES, 0, ringVertices);
+				}
+				stream->endFrame();
+			} else {
+				glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
+				glVertexAttribPointer(
+					0,                  // attribute 0. No particular reason for 0, but must match the layout in the shader.
+					3,                  // size
+					GL_FLOAT,           // type
+					GL_FALSE,           // normalized?
+					0,                  // stride
+					(void*)0            // array buffer offset
+				);
+				glDrawArrays(GL_LINE_LOOP, 0, NUM_CIRCLE_VERTICES);
+			}
+			glDisableVertexAttribArray(0);
+		}
 		// Swap buffers
 		glfwSwapBuffers(window);
 		glfwPollEvents();
-		error = glGetError();
-		if (error != GL_NO_ERROR)
-		{
-			fprintf(stderr, "0 OpenGL Error: %d\n", error);
+		if (!debugOutput) {
+			error = glGetError();
+			if (error != GL_NO_ERROR)
+			{
+				fprintf(stderr, "0 OpenGL Error: %d\n", error);
+			}
+		}
+		if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
+			if (canSwitch) {
+				canSwitch = false;
+				wantedOption = (wantedOption+1) % NUM_SEGMENT_OPTIONS;
+				wanted = segmentDefines(SEGMENT_OPTIONS[wantedOption]);
+				GLuint cached = shaderProgram->cached(wanted);
+				if (cached != 0) {
+					shader = cached;
+					defines = wanted;
+					segmentOption = wantedOption;
+					MAXSEGMENTS = SEGMENT_OPTIONS[segmentOption];
+					reloader->setActive(defines);
+					printf("%d segments\n", MAXSEGMENTS);
+				} else {
+					// never compile on the render thread; the current variant is drawn until
+					// the reloader has built this one
+					reloader->setActive(wanted, true);
+					printf("%d segments requested, building\n", SEGMENT_OPTIONS[wantedOption]);
+				}
+			}
+		} else {
+			canSwitch = true;
+		}
+		if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
+			if (canToggle) {
+				canToggle = false;
+				cpuRing = !cpuRing;
+				printf("ring built on the %s\n", cpuRing ? "CPU" : "GPU");
+			}
+		} else {
+			canToggle = true;
 		}
 	} // Check if the ESC key was pressed or the window was closed
 	while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
 		   glfwWindowShouldClose(window) == 0 );
 
+	simulating = false;
+	simulation.join();
+
+	shaderProgram->printStats("GPU ring");
+	ringProgram->printStats("CPU ring");
+	profiler.write("trace.json");
+	profiler.releaseGpu();
+	// the programs have to go while the context is still alive
+	delete reloader;
+	delete ringReloader;
+	delete shaderProgram;
+	delete ringProgram;
+	delete stream;
+
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
 
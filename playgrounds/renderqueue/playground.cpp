@@ -0,0 +1,609 @@
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+
+// Include GLEW
+#include <GL/glew.h>
+
+// Include GLFW
+#include <glfw3.h>
+GLFWwindow* window;
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace glm;
+
+typedef std::chrono::steady_clock Clock;
+
+std::string getFileContents(const char * fname) {
+	std::ifstream stream(fname, std::ios::in | std::ios::binary);
+	if (!stream.is_open()) {
+		fprintf(stderr, "Impossible to open %s. Are you in the right directory ?\n", fname);
+		getchar();
+		return "ERROR READING FILE";
+	}
+	std::ostringstream contents;
+	contents << stream.rdbuf();
+	return contents.str();
+}
+
+void compileShader(GLuint shaderID, const char * filename) {
+	std::cout << "Compiling shader " << filename << std::endl;
+	std::string src = getFileContents(filename);
+	int InfoLogLength;
+	char const * srcptr = src.c_str();
+	glShaderSource(shaderID, 1, &srcptr , NULL);
+	glCompileShader(shaderID);
+	glGetShaderiv(shaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> errormsg(InfoLogLength+1);
+		glGetShaderInfoLog(shaderID, InfoLogLength, NULL, &errormsg[0]);
+		printf("%s\n", &errormsg[0]);
+	}
+}
+
+GLuint loadProgram(const char * vertex_file_path, const char * fragment_file_path) {
+	GLuint programID = glCreateProgram();
+	GLuint vertexID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint fragmentID = glCreateShader(GL_FRAGMENT_SHADER);
+	compileShader(vertexID, vertex_file_path);
+	compileShader(fragmentID, fragment_file_path);
+	glAttachShader(programID, vertexID);
+	glAttachShader(programID, fragmentID);
+	glLinkProgram(programID);
+	int InfoLogLength;
+	glGetProgramiv(programID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+		glGetProgramInfoLog(programID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		fprintf(stderr,"%s\n", &ProgramErrorMessage[0]);
+	}
+	glDeleteShader(vertexID);
+	glDeleteShader(fragmentID);
+	return programID;
+}
+
+// Per-draw data. The same bytes serve as a std430 array of structs and as 5 RGBA32F
+// texels per draw in a texture buffer.
+struct DrawData {
+	glm::mat4 model;
+	glm::vec4 color;
+};
+
+// A range of an index buffer, drawn with the vertex array it belongs to.
+struct Mesh {
+	int vao;          // as returned by RenderQueue::addVao()
+	GLsizei count;
+	GLuint firstIndex;
+	GLint baseVertex;
+};
+
+// One draw: which program and mesh, how far from the camera, and its per-draw data.
+struct DrawPacket {
+	int program;      // as returned by RenderQueue::addProgram()
+	int mesh;         // as returned by RenderQueue::addMesh()
+	float depth;      // distance to the camera; nearer draws go first within a mesh
+	DrawData data;
+};
+
+struct FrameStats {
+	int drawCalls;
+	int programSwitches;
+	int vaoSwitches;
+	double submitMs;  // CPU time from the first sort step to the last GL call
+};
+
+// Layout of a glMultiDrawElementsIndirect command.
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Collects draw packets during a frame and submits them sorted by a 64-bit state key:
+//   program (8 bits) | vertex array (8 bits) | mesh (16 bits) | depth (32 bits)
+// so every program and vertex array is bound once. With GL 4.3 all draws sharing a program
+// and vertex array become one glMultiDrawElementsIndirect, reading their data from an SSBO.
+// Plain GL 3.3 has no way to tell the draws of a multi-draw apart in the shader, so there
+// each run of the same mesh becomes one instanced draw, reading from a texture buffer.
+class RenderQueue {
+public:
+	static const int MAX_DRAWS = 65536;
+private:
+	struct Program {
+		GLuint id;
+		GLint viewProjection;
+		GLint drawBase;
+	};
+	struct Batch {
+		int program;
+		int vao;
+		size_t firstCommand;
+		size_t commandCount;
+	};
+	std::vector<Program> programs;
+	std::vector<GLuint> vaos;
+	std::vector<Mesh> meshes;
+	std::vector<DrawPacket> packets;
+	std::vector<uint64_t> keys, keysTmp;
+	std::vector<uint32_t> order, orderTmp;
+	std::vector<DrawData> data;
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<Batch> batches;
+	bool indirect;
+	GLuint dataBuffer;
+	GLuint dataTexture;    // texture buffer view of dataBuffer, GL 3.3 path only
+	GLuint commandBuffer;
+	GLuint drawIDBuffer;   // 0,1,2,... as a per-instance attribute, GL 4.3 path only
+
+	uint64_t key(const DrawPacket& p) const {
+		union { float f; uint32_t u; } depth;
+		// the bits of a non-negative float sort like the float
+		depth.f = std::max(0.0f, p.depth);
+		return uint64_t(p.program) << 56 | uint64_t(meshes[p.mesh].vao) << 48
+			| uint64_t(p.mesh) << 32 | depth.u;
+	}
+	// least significant byte first; passes where all keys share the byte are skipped
+	void radixSort() {
+		const size_t n = keys.size();
+		order.resize(n);
+		keysTmp.resize(n);
+		orderTmp.resize(n);
+		for (size_t i=0; i<n; i++)
+			order[i] = i;
+		for (int shift=0; shift<64; shift+=8) {
+			size_t count[256] = { 0 };
+			for (size_t i=0; i<n; i++)
+				count[(keys[i] >> shift) & 0xff]++;
+			if (count[(keys[0] >> shift) & 0xff] == n)
+				continue;
+			size_t sum = 0;
+			for (int b=0; b<256; b++) {
+				size_t c = count[b];
+				count[b] = sum;
+				sum += c;
+			}
+			for (size_t i=0; i<n; i++) {
+				size_t dst = count[(keys[i] >> shift) & 0xff]++;
+				keysTmp[dst] = keys[i];
+				orderTmp[dst] = order[i];
+			}
+			keys.swap(keysTmp);
+			order.swap(orderTmp);
+		}
+	}
+	void upload(GLuint buffer, const void* src, size_t size) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		// orphan last frame's contents rather than wait for the GPU to be done with them
+		glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, src);
+	}
+	void bindData() {
+		if (indirect) {
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, dataBuffer);
+		} else {
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_BUFFER, dataTexture);
+		}
+	}
+	void useProgram(int program, const glm::mat4& viewProjection) {
+		glUseProgram(programs[program].id);
+		glUniformMatrix4fv(programs[program].viewProjection, 1, GL_FALSE, &viewProjection[0][0]);
+	}
+public:
+	explicit RenderQueue(bool useIndirect) : indirect(useIndirect), dataTexture(0), drawIDBuffer(0) {
+		glGenBuffers(1, &dataBuffer);
+		glGenBuffers(1, &commandBuffer);
+		if (indirect) {
+			std::vector<GLuint> ids(MAX_DRAWS);
+			for (int i=0; i<MAX_DRAWS; i++)
+				ids[i] = i;
+			glGenBuffers(1, &drawIDBuffer);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, drawIDBuffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, ids.size()*sizeof(GLuint), &ids[0], GL_STATIC_DRAW);
+		} else {
+			// a texture buffer needs storage before it can be attached
+			glBindBuffer(GL_COPY_WRITE_BUFFER, dataBuffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, sizeof(DrawData), NULL, GL_STREAM_DRAW);
+			glGenTextures(1, &dataTexture);
+			glBindTexture(GL_TEXTURE_BUFFER, dataTexture);
+			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, dataBuffer);
+		}
+	}
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+	~RenderQueue() {
+		glDeleteBuffers(1, &dataBuffer);
+		glDeleteBuffers(1, &commandBuffer);
+		if (drawIDBuffer)
+			glDeleteBuffers(1, &drawIDBuffer);
+		if (dataTexture)
+			glDeleteTextures(1, &dataTexture);
+	}
+	bool usesIndirect() const {
+		return indirect;
+	}
+	int addProgram(GLuint id) {
+		Program p = { id, glGetUniformLocation(id, "viewProjection"), glGetUniformLocation(id, "drawBase") };
+		if (!indirect) {
+			glUseProgram(id);
+			glUniform1i(glGetUniformLocation(id, "drawData"), 0);
+		}
+		programs.push_back(p);
+		return programs.size()-1;
+	}
+	// The vertex array gets the per-draw ID attribute at location 1 on the GL 4.3 path.
+	int addVao(GLuint vao) {
+		if (indirect) {
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer);
+			glEnableVertexAttribArray(1);
+			glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, 0, (void*)0);
+			glVertexAttribDivisor(1, 1);
+		}
+		vaos.push_back(vao);
+		return vaos.size()-1;
+	}
+	int addMesh(const Mesh& mesh) {
+		meshes.push_back(mesh);
+		return meshes.size()-1;
+	}
+	void push(const DrawPacket& packet) {
+		if (packets.size() < size_t(MAX_DRAWS))
+			packets.push_back(packet);
+	}
+	// sorts, merges and draws everything pushed since the last submit
+	FrameStats submit(const glm::mat4& viewProjection) {
+		Clock::time_point start = Clock::now();
+		FrameStats stats = { 0, 0, 0, 0.0 };
+		const size_t n = packets.size();
+		if (n == 0)
+			return stats;
+		keys.resize(n);
+		for (size_t i=0; i<n; i++)
+			keys[i] = key(packets[i]);
+		radixSort();
+		data.resize(n);
+		for (size_t i=0; i<n; i++)
+			data[i] = packets[order[i]].data;
+		upload(dataBuffer, &data[0], n*sizeof(DrawData));
+		bindData();
+
+		// runs of the same mesh become one command, runs of the same program and vertex
+		// array one batch
+		commands.clear();
+		batches.clear();
+		for (size_t i=0; i<n; ) {
+			const DrawPacket& p = packets[order[i]];
+			const Mesh& m = meshes[p.mesh];
+			size_t j = i+1;
+			while (j < n && packets[order[j]].mesh == p.mesh && packets[order[j]].program == p.program)
+				j++;
+			DrawElementsIndirectCommand cmd = { GLuint(m.count), GLuint(j-i), m.firstIndex, m.baseVertex, GLuint(i) };
+			if (batches.empty() || batches.back().program != p.program || batches.back().vao != m.vao) {
+				Batch b = { p.program, m.vao, commands.size(), 0 };
+				batches.push_back(b);
+			}
+			commands.push_back(cmd);
+			batches.back().commandCount++;
+			i = j;
+		}
+		if (indirect) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size()*sizeof(DrawElementsIndirectCommand), &commands[0], GL_STREAM_DRAW);
+		}
+
+		int program = -1, vao = -1;
+		for (auto b=batches.begin(); b!=batches.end(); ++b) {
+			if (b->program != program) {
+				program = b->program;
+				useProgram(program, viewProjection);
+				stats.programSwitches++;
+			}
+			if (b->vao != vao) {
+				vao = b->vao;
+				glBindVertexArray(vaos[vao]);
+				stats.vaoSwitches++;
+			}
+			if (indirect) {
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT,
+					(void*)(b->firstCommand*sizeof(DrawElementsIndirectCommand)), b->commandCount, 0);
+				stats.drawCalls++;
+			} else {
+				for (size_t c=b->firstCommand; c<b->firstCommand+b->commandCount; c++) {
+					const DrawElementsIndirectCommand& cmd = commands[c];
+					glUniform1i(programs[program].drawBase, cmd.baseInstance);
+					glDrawElementsInstancedBaseVertex(GL_TRIANGLES, cmd.count, GL_UNSIGNED_SHORT,
+						(void*)(cmd.firstIndex*sizeof(GLushort)), cmd.instanceCount, cmd.baseVertex);
+					stats.drawCalls++;
+				}
+			}
+		}
+		packets.clear();
+		stats.submitMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		return stats;
+	}
+	// Draws in push order, binding program and vertex array for every packet, the way the
+	// other playgrounds draw. For comparison with submit().
+	FrameStats submitUnsorted(const glm::mat4& viewProjection) {
+		Clock::time_point start = Clock::now();
+		FrameStats stats = { 0, 0, 0, 0.0 };
+		const size_t n = packets.size();
+		if (n == 0)
+			return stats;
+		data.resize(n);
+		for (size_t i=0; i<n; i++)
+			data[i] = packets[i].data;
+		upload(dataBuffer, &data[0], n*sizeof(DrawData));
+		bindData();
+		for (size_t i=0; i<n; i++) {
+			const DrawPacket& p = packets[i];
+			const Mesh& m = meshes[p.mesh];
+			useProgram(p.program, viewProjection);
+			glBindVertexArray(vaos[m.vao]);
+			if (indirect) {
+				glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, m.count, GL_UNSIGNED_SHORT,
+					(void*)(m.firstIndex*sizeof(GLushort)), 1, m.baseVertex, i);
+			} else {
+				glUniform1i(programs[p.program].drawBase, i);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, m.count, GL_UNSIGNED_SHORT,
+					(void*)(m.firstIndex*sizeof(GLushort)), 1, m.baseVertex);
+			}
+			stats.programSwitches++;
+			stats.vaoSwitches++;
+			stats.drawCalls++;
+		}
+		packets.clear();
+		stats.submitMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+		return stats;
+	}
+};
+
+// Two vertex pools, two meshes each. All meshes are centered on the origin.
+static const GLfloat pool0_vertices[] = {
+	// cube
+	-0.5f,-0.5f, 0.5f,   0.5f,-0.5f, 0.5f,   0.5f,-0.5f,-0.5f,  -0.5f,-0.5f,-0.5f,
+	-0.5f, 0.5f, 0.5f,   0.5f, 0.5f, 0.5f,   0.5f, 0.5f,-0.5f,  -0.5f, 0.5f,-0.5f,
+	// tetrahedron
+	 0.5f, 0.5f, 0.5f,  -0.5f,-0.5f, 0.5f,  -0.5f, 0.5f,-0.5f,   0.5f,-0.5f,-0.5f,
+};
+static const GLushort pool0_indices[] = {
+	// cube
+	0,1,5, 0,5,4,  1,2,6, 1,6,5,  2,3,7, 2,7,6,  3,0,4, 3,4,7,  4,5,6, 4,6,7,  3,2,1, 3,1,0,
+	// tetrahedron, relative to its first vertex
+	0,1,3, 0,2,1, 0,3,2, 1,2,3,
+};
+static const GLfloat pool1_vertices[] = {
+	// octahedron
+	 0.6f, 0.0f, 0.0f,  -0.6f, 0.0f, 0.0f,   0.0f, 0.6f, 0.0f,   0.0f,-0.6f, 0.0f,
+	 0.0f, 0.0f, 0.6f,   0.0f, 0.0f,-0.6f,
+	// pyramid
+	-0.5f,-0.4f, 0.5f,   0.5f,-0.4f, 0.5f,   0.5f,-0.4f,-0.5f,  -0.5f,-0.4f,-0.5f,
+	 0.0f, 0.6f, 0.0f,
+};
+static const GLushort pool1_indices[] = {
+	// octahedron
+	0,2,4, 4,2,1, 1,2,5, 5,2,0,  4,3,0, 1,3,4, 5,3,1, 0,3,5,
+	// pyramid, relative to its first vertex
+	0,1,4, 1,2,4, 2,3,4, 3,0,4,  0,3,2, 0,2,1,
+};
+
+static GLuint makeVao(const GLfloat* vertices, size_t vertexBytes, const GLushort* indices, size_t indexBytes) {
+	GLuint vao, buffers[2];
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glGenBuffers(2, buffers);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indices, GL_STATIC_DRAW);
+	return vao;
+}
+
+// Reports GL errors as the driver notices them, instead of polling glGetError() every frame.
+static void APIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity,
+		GLsizei length, const GLchar* message, const void* userParam) {
+	if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
+		return;
+	fprintf(stderr, "OpenGL %s (source 0x%x, type 0x%x, id %u): %s\n",
+		type == GL_DEBUG_TYPE_ERROR ? "Error" : "message", source, type, id, message);
+}
+
+struct SceneObject {
+	glm::vec3 position;
+	glm::vec4 color;
+	float spin;       // degrees per second
+	int mesh;
+	int program;
+};
+
+int main( void )
+{
+	// Initialise GLFW
+	if( !glfwInit() )
+	{
+		fprintf( stderr, "Failed to initialize GLFW\n" );
+		return -1;
+	}
+
+	glfwWindowHint(GLFW_SAMPLES, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+
+	// Open a window and create its OpenGL context
+	window = glfwCreateWindow( 1024, 768, "Render queue", NULL, NULL);
+	if( window == NULL ){
+		fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
+		glfwTerminate();
+		return -1;
+	}
+	glfwMakeContextCurrent(window);
+
+	glewExperimental = GL_TRUE;
+	// Initialize GLEW
+	if (glewInit() != GLEW_OK) {
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		return -1;
+	}
+	// glewInit() trips GL_INVALID_ENUM on core profiles; don't report that below
+	glGetError();
+
+	// with KHR_debug errors are reported as they happen; otherwise poll once a frame
+	bool debugOutput = GLEW_KHR_debug != 0;
+	if (debugOutput) {
+		glEnable(GL_DEBUG_OUTPUT);
+		glDebugMessageCallback(debugMessage, NULL);
+	}
+
+	// Ensure we can capture the escape key being pressed below
+	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+
+	// Dark blue background
+	glClearColor(0.0f, 0.0f, 0.4f, 0.0f);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+
+	// besides multi-draw-indirect and SSBOs the indirect path needs #version 430 shaders and
+	// non-zero baseInstance (GL 4.2), so it takes the whole of GL 4.3
+	bool indirect = GLEW_VERSION_4_3 != 0;
+	printf("Merging draws with %s\n", indirect ? "glMultiDrawElementsIndirect" : "instancing (no GL 4.3)");
+	RenderQueue* queue = new RenderQueue(indirect);
+
+	// load shaders
+	const char* vertexShader = indirect ? "vertex_indirect" : "vertex";
+	const char* fragmentShaders[] = { "fragment_flat", "fragment_shaded", "fragment_striped" };
+	const int NUM_PROGRAMS = sizeof(fragmentShaders)/sizeof(fragmentShaders[0]);
+	std::vector<GLuint> programs;
+	for (int i=0; i<NUM_PROGRAMS; i++) {
+		programs.push_back(loadProgram(vertexShader, fragmentShaders[i]));
+		queue->addProgram(programs.back());
+	}
+
+	// geometry
+	GLuint vao0 = makeVao(pool0_vertices, sizeof(pool0_vertices), pool0_indices, sizeof(pool0_indices));
+	GLuint vao1 = makeVao(pool1_vertices, sizeof(pool1_vertices), pool1_indices, sizeof(pool1_indices));
+	int pool0 = queue->addVao(vao0);
+	int pool1 = queue->addVao(vao1);
+	Mesh cube = { pool0, 36, 0, 0 };
+	Mesh tetrahedron = { pool0, 12, 36, 8 };
+	Mesh octahedron = { pool1, 24, 0, 0 };
+	Mesh pyramid = { pool1, 18, 24, 6 };
+	const int meshes[] = {
+		queue->addMesh(cube), queue->addMesh(tetrahedron),
+		queue->addMesh(octahedron), queue->addMesh(pyramid),
+	};
+	const int NUM_MESHES = sizeof(meshes)/sizeof(meshes[0]);
+
+	// a grid of objects with random meshes, programs and colors
+	const int GRID = 48;
+	std::vector<SceneObject> scene;
+	srand(1);
+	for (int z=0; z<GRID; z++) {
+		for (int x=0; x<GRID; x++) {
+			SceneObject o;
+			o.position = glm::vec3(x - GRID/2.0f, 0.0f, z - GRID/2.0f) * 1.5f;
+			o.color = glm::vec4(rand()%256/255.0f, rand()%256/255.0f, rand()%256/255.0f, 1.0f);
+			o.spin = 30.0f + rand()%120;
+			o.mesh = meshes[rand()%NUM_MESHES];
+			o.program = rand()%NUM_PROGRAMS;
+			scene.push_back(o);
+		}
+	}
+	printf("%d objects, %d meshes, %d programs\n", int(scene.size()), NUM_MESHES, NUM_PROGRAMS);
+
+	// matrices
+	glm::vec3 eye(0.0f, 30.0f, 55.0f);
+	glm::mat4 projection = glm::perspective(45.0f, 4.0f/3.0f, 0.1f, 200.0f);
+	glm::mat4 view       = glm::lookAt(
+		eye,              // Camera is above the grid
+		glm::vec3(0,0,0), // and looks at its center
+		glm::vec3(0,1,0)  // Head is up (set to 0,-1,0 to look upside-down)
+	);
+	glm::mat4 viewProjection = projection * view;
+
+	bool sorted = true;
+	bool canToggle = true;
+	FrameStats total = { 0, 0, 0, 0.0 };
+	int frames = 0;
+	double lastReport = glfwGetTime();
+
+	do{
+		// clear screen
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		float t = glfwGetTime();
+		for (auto o=scene.begin(); o!=scene.end(); ++o) {
+			DrawPacket p;
+			p.program = o->program;
+			p.mesh = o->mesh;
+			glm::vec3 d = o->position - eye;
+			p.depth = sqrt(d.x*d.x + d.y*d.y + d.z*d.z);
+			p.data.model = glm::rotate(glm::translate(glm::mat4(1.0f), o->position), o->spin*t, glm::vec3(0,1,0));
+			p.data.color = o->color;
+			queue->push(p);
+		}
+		FrameStats stats = sorted ? queue->submit(viewProjection) : queue->submitUnsorted(viewProjection);
+		total.drawCalls += stats.drawCalls;
+		total.programSwitches += stats.programSwitches;
+		total.vaoSwitches += stats.vaoSwitches;
+		total.submitMs += stats.submitMs;
+		frames++;
+
+		// Swap buffers
+		glfwSwapBuffers(window);
+		glfwPollEvents();
+		if (!debugOutput) {
+			GLenum error = glGetError();
+			if (error != GL_NO_ERROR)
+			{
+				fprintf(stderr, "0 OpenGL Error: %d\n", error);
+			}
+		}
+
+		double now = glfwGetTime();
+		if (now - lastReport >= 1.0) {
+			printf("%s: %.0f draw calls, %.0f program switches, %.0f VAO switches, %.3f ms submit per frame\n",
+				sorted ? "sorted" : "unsorted", double(total.drawCalls)/frames, double(total.programSwitches)/frames,
+				double(total.vaoSwitches)/frames, total.submitMs/frames);
+			FrameStats zero = { 0, 0, 0, 0.0 };
+			total = zero;
+			frames = 0;
+			lastReport = now;
+		}
+		if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) {
+			if (canToggle) {
+				canToggle = false;
+				sorted = !sorted;
+			}
+		} else {
+			canToggle = true;
+		}
+	} // Check if the ESC key was pressed or the window was closed
+	while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
+		   glfwWindowShouldClose(window) == 0 );
+
+	delete queue;
+	for (auto p=programs.begin(); p!=programs.end(); ++p)
+		glDeleteProgram(*p);
+
+	// Close OpenGL window and terminate GLFW
+	glfwTerminate();
+
+	return 0;
+}
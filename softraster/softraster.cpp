@@ -0,0 +1,750 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <assert.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// only needed for main() aka. the test code and the benchmark
+#include <iostream>
+#include <chrono>
+#include <stdio.h>
+
+// Same values as the GL enums, so the playgrounds' GL constants can be passed straight in.
+enum : unsigned {
+	SR_TRIANGLES = 0x0004,
+	SR_TRIANGLE_STRIP = 0x0005,
+	SR_UNSIGNED_BYTE = 0x1401,
+	SR_LESS = 0x0201,
+	SR_ALWAYS = 0x0207,
+	SR_DEPTH_TEST = 0x0B71,
+	SR_DEPTH_BUFFER_BIT = 0x0100,
+	SR_COLOR_BUFFER_BIT = 0x4000,
+};
+
+struct Vec4 {
+	float x,y,z,w;
+	Vec4() : x(0), y(0), z(0), w(0) {}
+	Vec4(float a,float b,float c,float d) : x(a), y(b), z(c), w(d) {}
+};
+
+// column major, like glm and GL
+struct Mat4 {
+	float m[16];
+	Mat4() {
+		for (int i=0; i<16; i++)
+			m[i] = (i%5 == 0) ? 1.0f : 0.0f;
+	}
+	float& at(int col, int row) { return m[col*4+row]; }
+	float at(int col, int row) const { return m[col*4+row]; }
+	Mat4 operator*(const Mat4& o) const {
+		Mat4 r;
+		for (int c=0; c<4; c++)
+			for (int rw=0; rw<4; rw++) {
+				float s = 0;
+				for (int k=0; k<4; k++)
+					s += at(k,rw) * o.at(c,k);
+				r.at(c,rw) = s;
+			}
+		return r;
+	}
+	Vec4 operator*(const Vec4& v) const {
+		return Vec4(
+			at(0,0)*v.x + at(1,0)*v.y + at(2,0)*v.z + at(3,0)*v.w,
+			at(0,1)*v.x + at(1,1)*v.y + at(2,1)*v.z + at(3,1)*v.w,
+			at(0,2)*v.x + at(1,2)*v.y + at(2,2)*v.z + at(3,2)*v.w,
+			at(0,3)*v.x + at(1,3)*v.y + at(2,3)*v.z + at(3,3)*v.w);
+	}
+	// the playgrounds pass degrees to glm, so these take degrees as well
+	static Mat4 perspective(float fovyDeg, float aspect, float zNear, float zFar) {
+		float f = 1.0f / std::tan(fovyDeg * float(M_PI) / 360.0f);
+		Mat4 r;
+		r.at(0,0) = f / aspect;
+		r.at(1,1) = f;
+		r.at(2,2) = (zFar+zNear) / (zNear-zFar);
+		r.at(2,3) = -1.0f;
+		r.at(3,2) = 2.0f*zFar*zNear / (zNear-zFar);
+		r.at(3,3) = 0.0f;
+		return r;
+	}
+	static Mat4 lookAt(float ex,float ey,float ez, float cx,float cy,float cz, float ux,float uy,float uz) {
+		float fx = cx-ex, fy = cy-ey, fz = cz-ez;
+		float fl = std::sqrt(fx*fx+fy*fy+fz*fz);
+		fx /= fl; fy /= fl; fz /= fl;
+		// s = f x up
+		float sx = fy*uz-fz*uy, sy = fz*ux-fx*uz, sz = fx*uy-fy*ux;
+		float sl = std::sqrt(sx*sx+sy*sy+sz*sz);
+		sx /= sl; sy /= sl; sz /= sl;
+		// u = s x f
+		float vx = sy*fz-sz*fy, vy = sz*fx-sx*fz, vz = sx*fy-sy*fx;
+		Mat4 r;
+		r.at(0,0) = sx;  r.at(1,0) = sy;  r.at(2,0) = sz;
+		r.at(0,1) = vx;  r.at(1,1) = vy;  r.at(2,1) = vz;
+		r.at(0,2) = -fx; r.at(1,2) = -fy; r.at(2,2) = -fz;
+		r.at(3,0) = -(sx*ex+sy*ey+sz*ez);
+		r.at(3,1) = -(vx*ex+vy*ey+vz*ez);
+		r.at(3,2) = fx*ex+fy*ey+fz*ez;
+		return r;
+	}
+	static Mat4 rotateY(float deg) {
+		float a = deg * float(M_PI) / 180.0f;
+		Mat4 r;
+		r.at(0,0) = std::cos(a);  r.at(2,0) = std::sin(a);
+		r.at(0,2) = -std::sin(a); r.at(2,2) = std::cos(a);
+		return r;
+	}
+};
+
+// What a fragment functor gets to see: gl_FragCoord and gl_FrontFacing.
+struct Fragment {
+	float x,y,z;
+	bool frontFacing;
+};
+
+// Runs a job on a fixed set of threads; the calling thread takes part as worker 0.
+class WorkerPool {
+private:
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(unsigned)>* job;
+	unsigned generation;
+	unsigned running; // workers still busy with the current job
+	bool quit;
+	void loop(unsigned idx) {
+		unsigned seen = 0;
+		for (;;) {
+			const std::function<void(unsigned)>* current;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]{ return quit || generation != seen; });
+				if (quit)
+					return;
+				seen = generation;
+				current = job;
+			}
+			(*current)(idx);
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--running == 0)
+				done.notify_one();
+		}
+	}
+public:
+	explicit WorkerPool(unsigned count) : job(NULL), generation(0), running(0), quit(false) {
+		for (unsigned i=1; i<count; i++)
+			threads.push_back(std::thread(&WorkerPool::loop, this, i));
+	}
+	WorkerPool(const WorkerPool&) = delete;
+	WorkerPool& operator=(const WorkerPool&) = delete;
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (auto it=threads.begin(); it!=threads.end(); ++it)
+			it->join();
+	}
+	unsigned size() const {
+		return threads.size()+1;
+	}
+	// calls fn(worker index) once on every worker and returns when all of them are done
+	void run(const std::function<void(unsigned)>& fn) {
+		if (threads.empty()) {
+			fn(0);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			running = threads.size();
+			generation++;
+		}
+		wake.notify_all();
+		fn(0);
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&]{ return running == 0; });
+	}
+};
+
+// A CPU implementation of the handful of GL calls the playgrounds use. The playgrounds
+// don't render through it; main() below re-creates their scenes for testing and benchmarks.
+// Triangles are set up and binned into screen tiles in parallel, then every tile is
+// rasterized by one worker, four pixels at a time, testing depth before shading.
+// Vertex and fragment shaders are functors:
+//   Vec4 vs(const float* attributes) returns the clip space position,
+//   Vec4 fs(const Fragment& f) returns the RGBA color in [0,1].
+class SoftRasterizer {
+public:
+	static const int TILE_SIZE = 64;
+	struct Stats {
+		uint64_t triangles; // after clipping
+		uint64_t fragments; // shaded, i.e. passed the depth test
+	};
+private:
+	struct TriSetup {
+		// edge functions a*x + b*y + c, positive inside
+		float a[3], b[3], c[3];
+		// on an edge (value exactly 0) only the owning triangle gets the pixel,
+		// so pixels on an edge shared by two triangles are drawn once
+		bool owner[3];
+		// window z as a plane over the screen
+		float za, zb, zc;
+		int minX, minY, maxX, maxY;
+		bool frontFacing;
+	};
+	struct ClipVertex {
+		float x,y,z,w;
+	};
+	int width, height;
+	int stride; // width rounded up to whole quads, so 4-wide loads stay inside a row
+	int tilesX, tilesY;
+	std::vector<uint32_t> color;
+	std::vector<float> depth;
+	uint32_t clearValue;
+	bool depthTest;
+	unsigned depthFunction;
+	WorkerPool pool;
+	// per worker, so binning needs no locks; tiles walk the workers in order to keep
+	// the submission order
+	std::vector<std::vector<TriSetup> > setups;
+	std::vector<std::vector<std::vector<uint32_t> > > bins;
+	std::vector<ClipVertex> clipped;
+	std::vector<uint32_t> triIndices;
+	Stats stats;
+
+	static uint32_t pack(const Vec4& c) {
+		auto channel = [](float f) -> uint32_t {
+			f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+			return uint32_t(f*255.0f + 0.5f);
+		};
+		return channel(c.x) | channel(c.y)<<8 | channel(c.z)<<16 | channel(c.w)<<24;
+	}
+	// clips the polygon against d(v) >= 0 (Sutherland-Hodgman)
+	template<class D>
+	static int clipPolygon(const ClipVertex* in, int n, ClipVertex* out, D d) {
+		int m = 0;
+		for (int i=0; i<n; i++) {
+			const ClipVertex& p = in[i];
+			const ClipVertex& q = in[(i+1)%n];
+			float dp = d(p), dq = d(q);
+			if (dp >= 0)
+				out[m++] = p;
+			if ((dp >= 0) != (dq >= 0)) {
+				float t = dp / (dp-dq);
+				ClipVertex v = { p.x+t*(q.x-p.x), p.y+t*(q.y-p.y), p.z+t*(q.z-p.z), p.w+t*(q.w-p.w) };
+				out[m++] = v;
+			}
+		}
+		return m;
+	}
+	// screen space setup of one triangle; false if it covers no pixel centers
+	bool setupTriangle(const float* s0, const float* s1, const float* s2, TriSetup& t) const {
+		float area = (s1[0]-s0[0])*(s2[1]-s0[1]) - (s2[0]-s0[0])*(s1[1]-s0[1]);
+		if (area == 0.0f)
+			return false;
+		// GL's default: counter-clockwise in window coordinates (y up) is the front
+		t.frontFacing = area > 0;
+		if (area < 0) {
+			std::swap(s1, s2);
+			area = -area;
+		}
+		const float* v[3] = { s0, s1, s2 };
+		for (int e=0; e<3; e++) {
+			const float* p = v[(e+1)%3];
+			const float* q = v[(e+2)%3];
+			// edge e is the one opposite vertex e
+			t.a[e] = p[1]-q[1];
+			t.b[e] = q[0]-p[0];
+			t.c[e] = p[0]*q[1] - p[1]*q[0];
+			t.owner[e] = t.a[e] > 0 || (t.a[e] == 0 && t.b[e] < 0);
+		}
+		t.za = (t.a[0]*s0[2] + t.a[1]*s1[2] + t.a[2]*s2[2]) / area;
+		t.zb = (t.b[0]*s0[2] + t.b[1]*s1[2] + t.b[2]*s2[2]) / area;
+		t.zc = (t.c[0]*s0[2] + t.c[1]*s1[2] + t.c[2]*s2[2]) / area;
+		float minx = std::min(s0[0], std::min(s1[0], s2[0]));
+		float maxx = std::max(s0[0], std::max(s1[0], s2[0]));
+		float miny = std::min(s0[1], std::min(s1[1], s2[1]));
+		float maxy = std::max(s0[1], std::max(s1[1], s2[1]));
+		t.minX = std::max(0, int(std::floor(minx)));
+		t.minY = std::max(0, int(std::floor(miny)));
+		t.maxX = std::min(width-1, int(std::ceil(maxx)));
+		t.maxY = std::min(height-1, int(std::ceil(maxy)));
+		return t.minX <= t.maxX && t.minY <= t.maxY;
+	}
+	// clips, projects and bins one clip space triangle for worker w
+	void binTriangle(unsigned w, const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2) {
+		// trivially outside one of the frustum planes?
+		if ((v0.x > v0.w && v1.x > v1.w && v2.x > v2.w) || (v0.x < -v0.w && v1.x < -v1.w && v2.x < -v2.w)
+			|| (v0.y > v0.w && v1.y > v1.w && v2.y > v2.w) || (v0.y < -v0.w && v1.y < -v1.w && v2.y < -v2.w))
+			return;
+		ClipVertex poly[3] = { v0, v1, v2 };
+		ClipVertex nearClipped[4], farClipped[5];
+		int n = clipPolygon(poly, 3, nearClipped, [](const ClipVertex& v) { return v.z + v.w; });
+		n = clipPolygon(nearClipped, n, farClipped, [](const ClipVertex& v) { return v.w - v.z; });
+		if (n < 3)
+			return;
+		float screen[5][3];
+		for (int i=0; i<n; i++) {
+			const ClipVertex& v = farClipped[i];
+			// GL window coordinates: origin bottom left, pixel centers at .5
+			screen[i][0] = (v.x/v.w*0.5f + 0.5f) * width;
+			screen[i][1] = (v.y/v.w*0.5f + 0.5f) * height;
+			screen[i][2] = v.z/v.w*0.5f + 0.5f;
+		}
+		std::vector<TriSetup>& out = setups[w];
+		for (int i=1; i+1<n; i++) {
+			TriSetup t;
+			if (!setupTriangle(screen[0], screen[i], screen[i+1], t))
+				continue;
+			uint32_t idx = out.size();
+			out.push_back(t);
+			for (int ty=t.minY/TILE_SIZE; ty<=t.maxY/TILE_SIZE; ty++)
+				for (int tx=t.minX/TILE_SIZE; tx<=t.maxX/TILE_SIZE; tx++)
+					bins[w][ty*tilesX+tx].push_back(idx);
+		}
+	}
+	// coverage and depth test of the four pixels starting at (x,y); returns one bit per pixel
+	unsigned quad(const TriSetup& t, int x, int y, const float* depthRow, float* z) const {
+#ifdef __SSE2__
+		const __m128 px = _mm_add_ps(_mm_set1_ps(x+0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+		const __m128 py = _mm_set1_ps(y+0.5f);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int e=0; e<3; e++) {
+			__m128 ev = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.a[e]), px),
+				_mm_mul_ps(_mm_set1_ps(t.b[e]), py)), _mm_set1_ps(t.c[e]));
+			__m128 in = t.owner[e] ? _mm_cmpge_ps(ev, zero) : _mm_cmpgt_ps(ev, zero);
+			inside = _mm_and_ps(inside, in);
+		}
+		__m128 zv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.za), px),
+			_mm_mul_ps(_mm_set1_ps(t.zb), py)), _mm_set1_ps(t.zc));
+		_mm_storeu_ps(z, zv);
+		if (depthTest && depthFunction == SR_LESS)
+			inside = _mm_and_ps(inside, _mm_cmplt_ps(zv, _mm_loadu_ps(depthRow + x)));
+		return _mm_movemask_ps(inside);
+#else
+		unsigned mask = 0;
+		for (int i=0; i<4; i++) {
+			float px = x+i+0.5f, py = y+0.5f;
+			bool in = true;
+			for (int e=0; e<3; e++) {
+				float ev = t.a[e]*px + t.b[e]*py + t.c[e];
+				in = in && (t.owner[e] ? ev >= 0 : ev > 0);
+			}
+			z[i] = t.za*px + t.zb*py + t.zc;
+			if (depthTest && depthFunction == SR_LESS)
+				in = in && z[i] < depthRow[x+i];
+			mask |= unsigned(in) << i;
+		}
+		return mask;
+#endif
+	}
+	template<class FS>
+	uint64_t rasterizeTile(int tile, const FS& fs) {
+		const int x0 = (tile % tilesX) * TILE_SIZE, y0 = (tile / tilesX) * TILE_SIZE;
+		const int x1 = std::min(width, x0+TILE_SIZE), y1 = std::min(height, y0+TILE_SIZE);
+		uint64_t shaded = 0;
+		for (unsigned w=0; w<setups.size(); w++) {
+			const std::vector<uint32_t>& bin = bins[w][tile];
+			for (auto it=bin.begin(); it!=bin.end(); ++it) {
+				const TriSetup& t = setups[w][*it];
+				const int xs = std::max(x0, t.minX) & ~3, xe = std::min(x1-1, t.maxX);
+				const int ys = std::max(y0, t.minY), ye = std::min(y1-1, t.maxY);
+				for (int y=ys; y<=ye; y++) {
+					float* depthRow = &depth[y*stride];
+					uint32_t* colorRow = &color[y*stride];
+					for (int x=xs; x<=xe; x+=4) {
+						float z[4];
+						unsigned mask = quad(t, x, y, depthRow, z);
+						// lanes right of the tile belong to the neighbour
+						for (int i=0; i<4; i++)
+							if (x+i > xe)
+								mask &= ~(1u << i);
+						for (int i=0; mask; i++, mask >>= 1) {
+							if (!(mask & 1))
+								continue;
+							if (depthTest)
+								depthRow[x+i] = z[i];
+							Fragment f = { x+i+0.5f, y+0.5f, z[i], t.frontFacing };
+							colorRow[x+i] = pack(fs(f));
+							shaded++;
+						}
+					}
+				}
+			}
+		}
+		return shaded;
+	}
+	// vertex shading, then binning and rasterization of the triangles in triIndices
+	template<class VS, class FS>
+	void draw(const float* vertices, int floatsPerVertex, const VS& vs, const FS& fs) {
+		if (triIndices.empty())
+			return;
+		const unsigned workers = pool.size();
+		uint32_t maxIdx = *std::max_element(triIndices.begin(), triIndices.end());
+		clipped.resize(maxIdx+1);
+		pool.run([&](unsigned w) {
+			for (uint32_t i=w; i<=maxIdx; i+=workers) {
+				Vec4 p = vs(vertices + size_t(i)*floatsPerVertex);
+				ClipVertex cv = { p.x, p.y, p.z, p.w };
+				clipped[i] = cv;
+			}
+		});
+		const size_t triCount = triIndices.size()/3;
+		pool.run([&](unsigned w) {
+			setups[w].clear();
+			for (auto it=bins[w].begin(); it!=bins[w].end(); ++it)
+				it->clear();
+			for (size_t i=triCount*w/workers; i<triCount*(w+1)/workers; i++)
+				binTriangle(w, clipped[triIndices[3*i]], clipped[triIndices[3*i+1]], clipped[triIndices[3*i+2]]);
+		});
+		for (unsigned w=0; w<workers; w++)
+			stats.triangles += setups[w].size();
+		std::atomic<int> nextTile(0);
+		std::atomic<uint64_t> shaded(0);
+		pool.run([&](unsigned) {
+			uint64_t mine = 0;
+			for (int tile; (tile = nextTile++) < tilesX*tilesY; )
+				mine += rasterizeTile(tile, fs);
+			shaded += mine;
+		});
+		stats.fragments += shaded;
+	}
+	// expands strips to triangle lists, using GL's winding for the odd triangles
+	template<class I>
+	void assemble(unsigned mode, int count, I index) {
+		triIndices.clear();
+		if (mode == SR_TRIANGLES) {
+			for (int i=0; i+2<count; i+=3) {
+				triIndices.push_back(index(i));
+				triIndices.push_back(index(i+1));
+				triIndices.push_back(index(i+2));
+			}
+		} else if (mode == SR_TRIANGLE_STRIP) {
+			for (int i=0; i+2<count; i++) {
+				triIndices.push_back(index(i%2 ? i+1 : i));
+				triIndices.push_back(index(i%2 ? i : i+1));
+				triIndices.push_back(index(i+2));
+			}
+		} else {
+			assert(!"unsupported primitive mode");
+		}
+	}
+public:
+	SoftRasterizer(int w, int h, unsigned threads = std::thread::hardware_concurrency())
+		: width(w), height(h), stride((w+3) & ~3),
+		  tilesX((w+TILE_SIZE-1)/TILE_SIZE), tilesY((h+TILE_SIZE-1)/TILE_SIZE),
+		  color(size_t(stride)*h, 0), depth(size_t(stride)*h, 1.0f), clearValue(0),
+		  depthTest(false), depthFunction(SR_LESS), pool(std::max(1u, threads)),
+		  setups(pool.size()), bins(pool.size(), std::vector<std::vector<uint32_t> >(tilesX*tilesY)) {
+		resetStats();
+	}
+	void clearColor(float r, float g, float b, float a) {
+		clearValue = pack(Vec4(r,g,b,a));
+	}
+	void enable(unsigned cap) {
+		if (cap == SR_DEPTH_TEST)
+			depthTest = true;
+	}
+	void disable(unsigned cap) {
+		if (cap == SR_DEPTH_TEST)
+			depthTest = false;
+	}
+	void depthFunc(unsigned func) {
+		assert(func == SR_LESS || func == SR_ALWAYS);
+		depthFunction = func;
+	}
+	void clear(unsigned mask) {
+		const unsigned workers = pool.size();
+		pool.run([&](unsigned w) {
+			for (int y=height*w/workers; y<int(height*(w+1)/workers); y++) {
+				if (mask & SR_COLOR_BUFFER_BIT)
+					std::fill(color.begin()+size_t(y)*stride, color.begin()+size_t(y+1)*stride, clearValue);
+				if (mask & SR_DEPTH_BUFFER_BIT)
+					std::fill(depth.begin()+size_t(y)*stride, depth.begin()+size_t(y+1)*stride, 1.0f);
+			}
+		});
+	}
+	// like glDrawArrays, with the vertex array passed in instead of bound
+	template<class VS, class FS>
+	void drawArrays(unsigned mode, int first, int count, const float* vertices, int floatsPerVertex, const VS& vs, const FS& fs) {
+		assemble(mode, count, [first](int i) { return uint32_t(first+i); });
+		draw(vertices, floatsPerVertex, vs, fs);
+	}
+	// like glDrawElements; only GL_UNSIGNED_BYTE indices, as the playgrounds use
+	template<class VS, class FS>
+	void drawElements(unsigned mode, int count, unsigned type, const void* indices, const float* vertices, int floatsPerVertex, const VS& vs, const FS& fs) {
+		assert(type == SR_UNSIGNED_BYTE);
+		(void)type;
+		const uint8_t* idx = static_cast<const uint8_t*>(indices);
+		assemble(mode, count, [idx](int i) { return uint32_t(idx[i]); });
+		draw(vertices, floatsPerVertex, vs, fs);
+	}
+	// RGBA8, row 0 at the bottom like glReadPixels
+	uint32_t pixel(int x, int y) const {
+		return color[size_t(y)*stride+x];
+	}
+	float depthAt(int x, int y) const {
+		return depth[size_t(y)*stride+x];
+	}
+	bool sameImage(const SoftRasterizer& other) const {
+		return width == other.width && height == other.height && color == other.color;
+	}
+	unsigned threads() const {
+		return pool.size();
+	}
+	const Stats& getStats() const {
+		return stats;
+	}
+	void resetStats() {
+		stats.triangles = 0;
+		stats.fragments = 0;
+	}
+};
+
+// ---- ports of the playground shaders ----
+
+// cube_vertex / the geometry shader's MVP multiply
+struct MVPVertexShader {
+	Mat4 MVP;
+	Vec4 operator()(const float* v) const {
+		return MVP * Vec4(v[0], v[1], v[2], 1.0f);
+	}
+};
+
+// exercise2-easy's vertex: positions are already in clip space
+struct PassThroughVertexShader {
+	Vec4 operator()(const float* v) const {
+		return Vec4(v[0], v[1], v[2], 1.0f);
+	}
+};
+
+// cube_fragment and exercise2-medium's fragment
+struct FrontBackFragmentShader {
+	Vec4 operator()(const Fragment& f) const {
+		return f.frontFacing ? Vec4(0.7f, 0.7f, 0.8f, 1.0f) : Vec4(1.0f, 0.4f, 0.0f, 1.0f);
+	}
+};
+
+// exercise2-easy's fragment
+struct PlasmaFragmentShader {
+	float offset;
+	Vec4 operator()(const Fragment& f) const {
+		return Vec4(std::sin(f.y/32.0f + f.x/64.0f + 2*offset),
+			std::sin(f.x/64 + 2*std::sin(offset)) * std::sin(f.y/64 + 2*std::cos(offset)), 0, 1.0f);
+	}
+};
+
+static const float cube_vertex_data[] = {
+	-0.5f,-0.5f, 0.5f,
+	 0.5f,-0.5f, 0.5f,
+	 0.5f,-0.5f,-0.5f,
+	-0.5f,-0.5f,-0.5f,
+	-0.5f, 0.5f, 0.5f,
+	 0.5f, 0.5f, 0.5f,
+	 0.5f, 0.5f,-0.5f,
+	-0.5f, 0.5f,-0.5f,
+};
+
+static const uint8_t cube_indices[] = {
+	0,3,1,2,6,3,7,0,4,1,5,6,4,7,
+};
+
+static const float quad_vertex_data[] = {
+	-1.0f, -1.0f, 0.0f,
+	-1.0f,  1.0f, 0.0f,
+	 1.0f, -1.0f, 0.0f,
+	 1.0f,  1.0f, 0.0f,
+};
+
+// What exercise2-medium's geometry shader emits for a full ring, as a triangle list:
+// every segment of the circle swept around the y axis in `segments` steps.
+static std::vector<float> makeRing(int circleVertices, int segments) {
+	std::vector<float> ret;
+	auto push = [&](float x, float y, float angle) {
+		ret.push_back(std::cos(angle)*x);
+		ret.push_back(y);
+		ret.push_back(std::sin(angle)*x);
+	};
+	for (int i=0; i<circleVertices; i++) {
+		float f0 = i * 2*M_PI / circleVertices, f1 = (i+1) * 2*M_PI / circleVertices;
+		float x0 = std::cos(f0)+2.0f, y0 = std::sin(f0);
+		float x1 = std::cos(f1)+2.0f, y1 = std::sin(f1);
+		for (int s=0; s<segments; s++) {
+			float a0 = s * 2*M_PI / segments, a1 = (s+1) * 2*M_PI / segments;
+			// same winding as the strip: (in0, out0, in1), (in1, out0, out1)
+			push(x0, y0, a0); push(x1, y1, a0); push(x0, y0, a1);
+			push(x0, y0, a1); push(x1, y1, a0); push(x1, y1, a1);
+		}
+	}
+	return ret;
+}
+
+// the ring has more vertices than GL_UNSIGNED_BYTE can index, so it goes through drawArrays
+static void drawRing(SoftRasterizer& r, const std::vector<float>& ring, const Mat4& MVP) {
+	MVPVertexShader vs = { MVP };
+	r.drawArrays(SR_TRIANGLES, 0, ring.size()/3, &ring[0], 3, vs, FrontBackFragmentShader());
+}
+
+static Mat4 playgroundCamera(float aspect) {
+	return Mat4::perspective(45.0f, aspect, 0.1f, 100.0f) * Mat4::lookAt(4,3,3, 0,0,0, 0,1,0);
+}
+
+struct CountingFragmentShader {
+	std::atomic<int>* count;
+	Vec4 operator()(const Fragment&) const {
+		(*count)++;
+		return Vec4(1,1,1,1);
+	}
+};
+
+struct SolidFragmentShader {
+	Vec4 c;
+	Vec4 operator()(const Fragment&) const {
+		return c;
+	}
+};
+
+static void runTests() {
+	// odd sizes, so the last tiles and quads are partial
+	const int W = 131, H = 75;
+	{
+		// the two triangles of the strip share a diagonal; every pixel must be drawn exactly once
+		SoftRasterizer r(W, H, 3);
+		std::atomic<int> count(0);
+		CountingFragmentShader fs = { &count };
+		r.drawArrays(SR_TRIANGLE_STRIP, 0, 4, quad_vertex_data, 3, PassThroughVertexShader(), fs);
+		assert(count == W*H);
+		assert(r.getStats().triangles == 2);
+	}
+	{
+		// winding decides gl_FrontFacing: counter-clockwise is the front
+		static const float ccw[] = { -1,-1,0, 1,-1,0, -1,1,0 };
+		static const float cw[] = { -1,-1,0, -1,1,0, 1,-1,0 };
+		SoftRasterizer r(W, H, 2);
+		r.drawArrays(SR_TRIANGLES, 0, 3, ccw, 3, PassThroughVertexShader(), FrontBackFragmentShader());
+		assert(r.pixel(2,2) == 0xffccb3b3u);
+		r.drawArrays(SR_TRIANGLES, 0, 3, cw, 3, PassThroughVertexShader(), FrontBackFragmentShader());
+		assert(r.pixel(2,2) == 0xff0066ffu);
+	}
+	{
+		// depth test GL_LESS keeps the nearer triangle regardless of the order
+		static const float nearTri[] = { -1,-1,-0.5f, 3,-1,-0.5f, -1,3,-0.5f };
+		static const float farTri[] = { -1,-1,0.5f, 3,-1,0.5f, -1,3,0.5f };
+		SolidFragmentShader red = { Vec4(1,0,0,1) }, green = { Vec4(0,1,0,1) };
+		for (int order=0; order<2; order++) {
+			SoftRasterizer r(W, H, 4);
+			r.clearColor(0,0,0.4f,0);
+			r.clear(SR_COLOR_BUFFER_BIT | SR_DEPTH_BUFFER_BIT);
+			r.enable(SR_DEPTH_TEST);
+			r.depthFunc(SR_LESS);
+			if (order == 0) {
+				r.drawArrays(SR_TRIANGLES, 0, 3, nearTri, 3, PassThroughVertexShader(), red);
+				r.drawArrays(SR_TRIANGLES, 0, 3, farTri, 3, PassThroughVertexShader(), green);
+			} else {
+				r.drawArrays(SR_TRIANGLES, 0, 3, farTri, 3, PassThroughVertexShader(), green);
+				r.drawArrays(SR_TRIANGLES, 0, 3, nearTri, 3, PassThroughVertexShader(), red);
+			}
+			assert(r.pixel(W/2, H/2) == 0xff0000ffu);
+			assert(std::fabs(r.depthAt(W/2, H/2) - 0.25f) < 1e-5f);
+		}
+	}
+	{
+		// vertices behind the camera get clipped instead of wrapping around
+		static const float behind[] = { -1,-0.3f,0, 1,-0.3f,0, 0,-0.3f,3.0f };
+		MVPVertexShader vs;
+		vs.MVP = Mat4::perspective(45.0f, float(W)/H, 0.1f, 100.0f) * Mat4::lookAt(0,0,2, 0,0,0, 0,1,0);
+		SoftRasterizer r(W, H, 2);
+		std::atomic<int> count(0);
+		CountingFragmentShader fs = { &count };
+		r.drawArrays(SR_TRIANGLES, 0, 3, behind, 3, vs, fs);
+		assert(count > 0 && count < W*H);
+	}
+	{
+		// the cube as exercise1-medium draws it, and the ring: any core count gives the same image
+		std::vector<float> ring = makeRing(50, 80);
+		Mat4 MVP = playgroundCamera(float(W)/H) * Mat4::rotateY(30.0f);
+		MVPVertexShader vs = { MVP };
+		SoftRasterizer single(W, H, 1), multi(W, H, 5);
+		SoftRasterizer* both[] = { &single, &multi };
+		for (int i=0; i<2; i++) {
+			SoftRasterizer& r = *both[i];
+			r.clearColor(0,0,0.4f,0);
+			r.clear(SR_COLOR_BUFFER_BIT | SR_DEPTH_BUFFER_BIT);
+			r.enable(SR_DEPTH_TEST);
+			r.depthFunc(SR_LESS);
+			drawRing(r, ring, MVP);
+			r.drawElements(SR_TRIANGLE_STRIP, 14, SR_UNSIGNED_BYTE, cube_indices, cube_vertex_data, 3, vs, FrontBackFragmentShader());
+		}
+		assert(single.sameImage(multi));
+		assert(single.getStats().fragments == multi.getStats().fragments);
+		// the cube at the origin covers the center
+		assert(single.pixel(W/2, H/2) == 0xffccb3b3u);
+	}
+}
+
+// renders `frames` frames of a scene and prints throughput
+template<class Scene>
+static void bench(const char* name, unsigned threads, int frames, Scene scene) {
+	const int W = 1024, H = 768;
+	SoftRasterizer r(W, H, threads);
+	r.clearColor(0.0f, 0.0f, 0.4f, 0.0f);
+	scene(r, 0); // warm up
+	r.resetStats();
+	auto start = std::chrono::steady_clock::now();
+	for (int f=0; f<frames; f++)
+		scene(r, f);
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%-8s %2u threads: %7.1f fps %8.1f Mpix/s %8.2f Mtris/s %8.1f Mfrags/s\n",
+		name, r.threads(), frames/s, double(W)*H*frames/s/1e6,
+		r.getStats().triangles/s/1e6, r.getStats().fragments/s/1e6);
+}
+
+int main () {
+	#ifdef NDEBUG
+	#error "The tests only work with assertions enabled."
+	#endif
+	runTests();
+	std::cout << "All tests passed." << std::endl;
+
+	const Mat4 camera = playgroundCamera(4.0f/3.0f);
+	const std::vector<float> ring = makeRing(200, 400);
+	std::vector<unsigned> threadCounts;
+	for (unsigned t=1; t<std::thread::hardware_concurrency(); t*=2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(std::max(1u, std::thread::hardware_concurrency()));
+	for (auto t=threadCounts.begin(); t!=threadCounts.end(); ++t) {
+		// exercise1-medium: one cube, 12 triangles
+		bench("cube", *t, 200, [&](SoftRasterizer& r, int f) {
+			r.clear(SR_COLOR_BUFFER_BIT | SR_DEPTH_BUFFER_BIT);
+			r.enable(SR_DEPTH_TEST);
+			r.depthFunc(SR_LESS);
+			MVPVertexShader vs = { camera * Mat4::rotateY(45.0f + f) };
+			r.drawElements(SR_TRIANGLE_STRIP, 14, SR_UNSIGNED_BYTE, cube_indices, cube_vertex_data, 3, vs, FrontBackFragmentShader());
+		});
+		// exercise2-easy: a full screen quad with a sin() per channel
+		bench("plasma", *t, 100, [&](SoftRasterizer& r, int f) {
+			r.clear(SR_COLOR_BUFFER_BIT | SR_DEPTH_BUFFER_BIT);
+			PlasmaFragmentShader fs = { 0.05f*f };
+			r.drawArrays(SR_TRIANGLE_STRIP, 0, 4, quad_vertex_data, 3, PassThroughVertexShader(), fs);
+		});
+		// exercise2-medium's ring, finely tessellated: 160k triangles
+		bench("ring", *t, 20, [&](SoftRasterizer& r, int f) {
+			r.clear(SR_COLOR_BUFFER_BIT | SR_DEPTH_BUFFER_BIT);
+			r.enable(SR_DEPTH_TEST);
+			r.depthFunc(SR_LESS);
+			drawRing(r, ring, camera * Mat4::rotateY(float(f)));
+		});
+	}
+	return 0;
+}